@@ -0,0 +1,357 @@
+/*!
+ * \file vec_bench.c
+ * \brief Micro-benchmarks for the vec.h API
+ * \details Build and run (from this directory):
+ * ```
+ * make
+ * ./vec_bench [--json] [--max-len N] > bench_output.txt
+ * ```
+ * The `std::vector` rows come from `vec_bench_std.cpp`, which is linked into
+ * the same program. Define `BENCH_NO_STD` to build this file on its own with a
+ * C compiler only.
+ * Every row reports the total time of one benchmark for one element size and
+ * vector length, the time per element, and the number of allocator calls that
+ * were made while it ran (for vec.h implementations only).
+ */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#define VEC_IMPLEMENTATION
+#include "vec.h"
+#include "vec_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+double
+bench_now_ns(void)
+{
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+  if (!freq.QuadPart) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+double
+bench_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+#endif
+
+// Total number of elements that each benchmark should touch; short vectors
+// are repeated until roughly this amount of work was done.
+#define BENCH_WORK (1 << 22)
+
+// Vectors larger than this (in bytes) are skipped to keep memory use bounded.
+#define BENCH_MAX_BYTES ((size_t)1 << 30)
+
+size_t bench_allocs;
+size_t bench_reallocs;
+size_t bench_frees;
+volatile unsigned char bench_sink;
+static int bench_json;
+static int bench_rows;
+
+static void *
+bench_alloc(
+    void *ctx,
+    size_t size)
+{
+  (void)ctx;
+  bench_allocs++;
+  return malloc(size);
+}
+
+static void *
+bench_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old_size,
+    size_t new_size)
+{
+  (void)ctx;
+  (void)old_size;
+  bench_reallocs++;
+  return realloc(ptr, new_size);
+}
+
+static void
+bench_free(
+    void *ctx,
+    void *ptr,
+    size_t size)
+{
+  (void)ctx;
+  (void)size;
+  bench_frees++;
+  free(ptr);
+}
+
+static const vec_allocator_t bench_allocator = {
+  .alloc_fn   = bench_alloc,
+  .realloc_fn = bench_realloc,
+  .free_fn    = bench_free,
+  .ctx        = NULL,
+};
+
+void
+bench_reset_counters(void)
+{
+  bench_allocs   = 0;
+  bench_reallocs = 0;
+  bench_frees    = 0;
+}
+
+void
+bench_report(
+    const char *name,
+    const char *impl,
+    size_t elemsize,
+    size_t length,
+    size_t reps,
+    double ns)
+{
+  double per_elem = ns / ((double)length * (double)reps);
+  if (bench_json) {
+    printf("%s  {\"bench\": \"%s\", \"impl\": \"%s\", \"elemsize\": %zu, \"length\": %zu, "
+           "\"reps\": %zu, \"ns_total\": %.0f, \"ns_per_elem\": %.4f, "
+           "\"allocs\": %zu, \"reallocs\": %zu, \"frees\": %zu}",
+           bench_rows ? ",\n" : "", name, impl, elemsize, length, reps, ns, per_elem,
+           bench_allocs, bench_reallocs, bench_frees);
+  } else {
+    printf("%s,%s,%zu,%zu,%zu,%.0f,%.4f,%zu,%zu,%zu\n",
+           name, impl, elemsize, length, reps, ns, per_elem,
+           bench_allocs, bench_reallocs, bench_frees);
+  }
+  bench_rows++;
+}
+
+#ifdef BENCH_NO_STD
+#define BENCH_STD_RUN(size, len, reps) ((void)0)
+#else
+#define BENCH_STD_RUN(size, len, reps) bench_std_run(size, len, reps)
+#endif
+
+/*
+ * Declares all benchmarks for an element type of `size` bytes. The element
+ * is a plain struct so that the copies are representative of user types.
+ */
+#define BENCH_DECLARE(size)                                                   \
+  typedef struct { unsigned char b[size]; } elem##size;                       \
+  VEC_DECLARE_TYPED(elem##size, vec_elem##size)                               \
+                                                                              \
+  static void                                                                 \
+  bench_run_##size(                                                           \
+      size_t len)                                                             \
+  {                                                                           \
+    if (len * sizeof(elem##size) > BENCH_MAX_BYTES) {                         \
+      return;                                                                 \
+    }                                                                         \
+    size_t reps = BENCH_WORK / len ? BENCH_WORK / len : 1;                    \
+    elem##size val;                                                           \
+    memset(&val, 0x5a, sizeof(val));                                          \
+    elem##size *arr = malloc(len * sizeof(elem##size));                       \
+    if (!arr) {                                                               \
+      return;                                                                 \
+    }                                                                         \
+    for (size_t i = 0; i < len; i++) {                                        \
+      arr[i] = val;                                                           \
+    }                                                                         \
+    double t;                                                                 \
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec(elem##size) v = vec_init_w_allocator(elem##size, &bench_allocator); \
+      for (size_t i = 0; i < len; i++) {                                      \
+        vec_push((vec_t *)&v, &val);                                          \
+      }                                                                       \
+      bench_sink ^= v[len - 1].b[0];                                          \
+      vec_fini(v);                                                            \
+    }                                                                         \
+    bench_report("push", "vec_push", size, len, reps, bench_now_ns() - t);    \
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec(elem##size) v = vec_init_w_allocator(elem##size, &bench_allocator); \
+      for (size_t i = 0; i < len; i++) {                                      \
+        vec_elem##size##_push(&v, val);                                       \
+      }                                                                       \
+      bench_sink ^= v[len - 1].b[0];                                          \
+      vec_fini(v);                                                            \
+    }                                                                         \
+    bench_report("push", "typed_push", size, len, reps, bench_now_ns() - t);  \
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      size_t cap = VEC_INIT_CAP, n = 0;                                       \
+      elem##size *a = malloc(cap * sizeof(elem##size));                       \
+      for (size_t i = 0; i < len; i++) {                                      \
+        if (n == cap) {                                                       \
+          cap = cap * 2;                                                      \
+          a = realloc(a, cap * sizeof(elem##size));                           \
+        }                                                                     \
+        a[n++] = val;                                                         \
+      }                                                                       \
+      bench_sink ^= a[len - 1].b[0];                                          \
+      free(a);                                                                \
+    }                                                                         \
+    bench_report("push", "array", size, len, reps, bench_now_ns() - t);       \
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec_seg_t s;                                                            \
+      vec_seg_init(&s, sizeof(elem##size), NULL, NULL);                       \
+      s.allocator = &bench_allocator;                                         \
+      for (size_t i = 0; i < len; i++) {                                      \
+        vec_seg_push(&s, &val);                                               \
+      }                                                                       \
+      bench_sink ^= ((elem##size *)vec_seg_at(&s, len - 1))->b[0];            \
+      vec_seg_fini(&s);                                                       \
+    }                                                                         \
+    bench_report("push", "vec_seg_push", size, len, reps, bench_now_ns() - t);\
+                                                                              \
+    if (len <= 1024) {                                                        \
+      svec(elem##size) v = svec_init_w_cap(elem##size, 1024);                 \
+      bench_reset_counters();                                                 \
+      t = bench_now_ns();                                                     \
+      for (size_t r = 0; r < reps; r++) {                                     \
+        vec_setlen((vec_t *)&v, 0);                                           \
+        for (size_t i = 0; i < len; i++) {                                    \
+          vec_push((vec_t *)&v, &val);                                        \
+        }                                                                     \
+        bench_sink ^= v[len - 1].b[0];                                        \
+      }                                                                       \
+      bench_report("push", "svec_push", size, len, reps, bench_now_ns() - t); \
+      vec_fini(v);                                                            \
+    }                                                                         \
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec(elem##size) v = vec_init_w_allocator(elem##size, &bench_allocator); \
+      vec_append((vec_t *)&v, arr, len);                                      \
+      bench_sink ^= v[len - 1].b[0];                                          \
+      vec_fini(v);                                                            \
+    }                                                                         \
+    bench_report("append", "vec_append", size, len, reps, bench_now_ns() - t);\
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec(elem##size) v = vec_init_w_allocator(elem##size, &bench_allocator); \
+      vec_setlen((vec_t *)&v, len);                                           \
+      bench_sink ^= (unsigned char)vec_len(v);                                \
+      vec_fini(v);                                                            \
+    }                                                                         \
+    bench_report("setlen", "vec_setlen", size, len, reps, bench_now_ns() - t);\
+                                                                              \
+    vec(elem##size) v = vec_init_w_allocator(elem##size, &bench_allocator);   \
+    vec_append((vec_t *)&v, arr, len);                                        \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      elem##size *ref;                                                        \
+      unsigned char acc = 0;                                                  \
+      vec_foreach(ref, v) {                                                   \
+        acc ^= ref->b[0];                                                     \
+      }                                                                       \
+      bench_sink ^= acc;                                                      \
+    }                                                                         \
+    bench_report("iterate", "vec_foreach", size, len, reps, bench_now_ns() - t);\
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      unsigned char acc = 0;                                                  \
+      vec_foreach_t(elem##size, ref, v) {                                     \
+        acc ^= ref->b[0];                                                     \
+      }                                                                       \
+      bench_sink ^= acc;                                                      \
+    }                                                                         \
+    bench_report("iterate", "vec_foreach_t", size, len, reps, bench_now_ns() - t);\
+                                                                              \
+    bench_reset_counters();                                                   \
+    t = bench_now_ns();                                                       \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      unsigned char acc = 0;                                                  \
+      for (size_t i = 0; i < len; i++) {                                      \
+        acc ^= arr[i].b[0];                                                   \
+      }                                                                       \
+      bench_sink ^= acc;                                                      \
+    }                                                                         \
+    bench_report("iterate", "array", size, len, reps, bench_now_ns() - t);    \
+                                                                              \
+    bench_reset_counters();                                                   \
+    double pop_ns = 0;                                                        \
+    for (size_t r = 0; r < reps; r++) {                                       \
+      vec_setlen((vec_t *)&v, len);                                           \
+      elem##size out;                                                         \
+      t = bench_now_ns();                                                     \
+      for (size_t i = 0; i < len; i++) {                                      \
+        vec_pop((vec_t *)&v, &out);                                           \
+      }                                                                       \
+      pop_ns += bench_now_ns() - t;                                           \
+      bench_sink ^= out.b[0];                                                 \
+    }                                                                         \
+    bench_report("pop", "vec_pop", size, len, reps, pop_ns);                  \
+                                                                              \
+    vec_fini(v);                                                              \
+    free(arr);                                                                \
+    BENCH_STD_RUN(size, len, reps);                                           \
+  }
+
+BENCH_DECLARE(4)
+BENCH_DECLARE(16)
+BENCH_DECLARE(64)
+BENCH_DECLARE(256)
+
+int
+main(
+    int argc,
+    char **argv)
+{
+  size_t max_len = 100000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json")) {
+      bench_json = 1;
+    } else if (!strcmp(argv[i], "--max-len") && i + 1 < argc) {
+      max_len = (size_t)strtoull(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--json] [--max-len N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (bench_json) {
+    printf("[\n");
+  } else {
+    printf("bench,impl,elemsize,length,reps,ns_total,ns_per_elem,allocs,reallocs,frees\n");
+  }
+
+  for (size_t len = 10; len <= max_len; len *= 10) {
+    bench_run_4(len);
+    bench_run_16(len);
+    bench_run_64(len);
+    bench_run_256(len);
+  }
+
+  if (bench_json) {
+    printf("\n]\n");
+  }
+  return 0;
+}
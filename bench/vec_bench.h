@@ -0,0 +1,65 @@
+/*!
+ * \file vec_bench.h
+ * \brief Declarations shared by the C and C++ parts of the benchmarks
+ */
+#ifndef VEC_BENCH_HEADER
+#define VEC_BENCH_HEADER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of allocator calls made since the last `bench_reset_counters()`.
+extern size_t bench_allocs;
+extern size_t bench_reallocs;
+extern size_t bench_frees;
+//! Written by every benchmark so that the measured loops are not optimized out.
+extern volatile unsigned char bench_sink;
+
+double
+bench_now_ns(void);
+
+void
+bench_reset_counters(void);
+
+/*!
+ * \brief Prints one row of results, along with the allocator counters.
+ *
+ * \param name Name of the benchmark
+ * \param impl Name of the implementation that was measured
+ * \param elemsize Size (in bytes) of an element
+ * \param length Number of elements per repetition
+ * \param reps Number of repetitions
+ * \param ns Total time (in nanoseconds) of all repetitions
+ */
+void
+bench_report(
+  const char *name,
+  const char *impl,
+  size_t elemsize,
+  size_t length,
+  size_t reps,
+  double ns);
+
+/*!
+ * \brief Runs the `std::vector` counterparts of the benchmarks (see
+ * `vec_bench_std.cpp`). Does nothing for element sizes that are not
+ * benchmarked.
+ *
+ * \param elemsize Size (in bytes) of an element
+ * \param len Number of elements per repetition
+ * \param reps Number of repetitions
+ */
+void
+bench_std_run(
+  size_t elemsize,
+  size_t len,
+  size_t reps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+/*!
+ * \file vec_bench_std.cpp
+ * \brief `std::vector` counterparts of the benchmarks in `vec_bench.c`
+ * \details Every benchmark mirrors the vec.h one of the same name, with the
+ * same element types, lengths and number of repetitions. Allocations go
+ * through a counting allocator so that the `allocs` and `frees` columns can
+ * be compared; `std::vector` never reallocates in place, so `reallocs` is
+ * always 0.
+ */
+#include "vec_bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+template <typename T>
+struct bench_std_allocator {
+  typedef T value_type;
+
+  bench_std_allocator() {}
+
+  template <typename U>
+  bench_std_allocator(const bench_std_allocator<U> &) {}
+
+  T *
+  allocate(
+      std::size_t n)
+  {
+    bench_allocs++;
+    void *p = std::malloc(n * sizeof(T));
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+
+  void
+  deallocate(
+      T *p,
+      std::size_t)
+  {
+    bench_frees++;
+    std::free(p);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const bench_std_allocator<T> &, const bench_std_allocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const bench_std_allocator<T> &, const bench_std_allocator<U> &) { return false; }
+
+template <std::size_t Size>
+struct bench_std_elem {
+  unsigned char b[Size];
+};
+
+template <std::size_t Size>
+void
+bench_std_run_size(
+    std::size_t len,
+    std::size_t reps)
+{
+  typedef bench_std_elem<Size> elem;
+  typedef std::vector<elem, bench_std_allocator<elem> > vector;
+
+  elem val;
+  std::memset(&val, 0x5a, sizeof(val));
+  std::vector<elem> arr(len, val);
+  double t;
+
+  bench_reset_counters();
+  t = bench_now_ns();
+  for (std::size_t r = 0; r < reps; r++) {
+    vector v;
+    for (std::size_t i = 0; i < len; i++) {
+      v.push_back(val);
+    }
+    bench_sink ^= v[len - 1].b[0];
+  }
+  bench_report("push", "std_vector", Size, len, reps, bench_now_ns() - t);
+
+  bench_reset_counters();
+  t = bench_now_ns();
+  for (std::size_t r = 0; r < reps; r++) {
+    vector v;
+    v.insert(v.end(), arr.begin(), arr.end());
+    bench_sink ^= v[len - 1].b[0];
+  }
+  bench_report("append", "std_vector", Size, len, reps, bench_now_ns() - t);
+
+  bench_reset_counters();
+  t = bench_now_ns();
+  for (std::size_t r = 0; r < reps; r++) {
+    vector v;
+    v.resize(len);
+    bench_sink ^= (unsigned char)v.size();
+  }
+  bench_report("setlen", "std_vector", Size, len, reps, bench_now_ns() - t);
+
+  vector v(arr.begin(), arr.end());
+  bench_reset_counters();
+  t = bench_now_ns();
+  for (std::size_t r = 0; r < reps; r++) {
+    unsigned char acc = 0;
+    for (typename vector::const_iterator it = v.begin(); it != v.end(); ++it) {
+      acc ^= it->b[0];
+    }
+    bench_sink ^= acc;
+  }
+  bench_report("iterate", "std_vector", Size, len, reps, bench_now_ns() - t);
+
+  bench_reset_counters();
+  double pop_ns = 0;
+  for (std::size_t r = 0; r < reps; r++) {
+    v.resize(len, val);
+    elem out = val;
+    t = bench_now_ns();
+    for (std::size_t i = 0; i < len; i++) {
+      out = v.back();
+      v.pop_back();
+    }
+    pop_ns += bench_now_ns() - t;
+    bench_sink ^= out.b[0];
+  }
+  bench_report("pop", "std_vector", Size, len, reps, pop_ns);
+}
+
+} // namespace
+
+extern "C" void
+bench_std_run(
+    std::size_t elemsize,
+    std::size_t len,
+    std::size_t reps)
+{
+  switch (elemsize) {
+    case 4:   bench_std_run_size<4>(len, reps);   break;
+    case 16:  bench_std_run_size<16>(len, reps);  break;
+    case 64:  bench_std_run_size<64>(len, reps);  break;
+    case 256: bench_std_run_size<256>(len, reps); break;
+    default:  break;
+  }
+}
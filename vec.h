@@ -35,6 +35,91 @@
 #define VEC_INIT_CAP 8
 #endif
 
+#ifndef VEC_ARENA_ALIGN
+/*!
+ * \brief Alignment (in bytes) of every block that is handed out by a `vec_arena_t`.
+ * Must be at least the alignment of `max_align_t`, like `malloc()` blocks.
+ */
+#define VEC_ARENA_ALIGN 16
+#endif
+
+#ifndef VEC_POOL_MIN_BLOCK
+/*!
+ * \brief Size (in bytes) of the smallest size class of the pool allocator (see
+ * `vec_pool_allocator()`). Must be a power of two. Every following class is
+ * twice as large as the last.
+ */
+#define VEC_POOL_MIN_BLOCK 64
+#endif
+
+#ifndef VEC_POOL_CLASSES
+/*!
+ * \brief Number of size classes of the pool allocator. Larger blocks go
+ * straight to `malloc()`/`free()`.
+ */
+#define VEC_POOL_CLASSES 12
+#endif
+
+#ifndef VEC_POOL_CACHE_MAX
+/*!
+ * \brief Number of free blocks per size class that a thread keeps for itself
+ * before half of them are handed over to the global lists
+ */
+#define VEC_POOL_CACHE_MAX 64
+#endif
+
+/*!
+ * \def VEC_POOL_DEFAULT
+ * \brief If defined, the pool allocator is the default allocator from the
+ * start, instead of the plain `malloc`/`realloc`/`free` one.
+ */
+
+#ifndef VEC_CACHE_LINE
+/*!
+ * \brief Size (in bytes) of a cache line, used to split and pad data that is
+ * shared between threads
+ */
+#define VEC_CACHE_LINE 64
+#endif
+
+#ifndef VEC_PARALLEL_MAX_THREADS
+/*!
+ * \brief Upper bound on the number of worker threads of the built-in pool
+ */
+#define VEC_PARALLEL_MAX_THREADS 64
+#endif
+
+/*!
+ * \def VEC_PARALLEL
+ * \brief If defined, `vec_parallel_for()` runs on a built-in thread pool
+ * (requires pthreads on POSIX systems). Otherwise, it runs on the calling
+ * thread unless a job system is installed with `vec_set_job_system()`.
+ */
+
+/*!
+ * \def VEC_PARALLEL_THREADS
+ * \brief Number of threads (including the calling thread) used by the
+ * built-in pool. If 0 or undefined, the number of online processors is used.
+ */
+
+#ifndef VEC_HUGE_PAGE_SIZE
+/*!
+ * \brief Size (in bytes) of the huge pages requested with `VEC_RESERVE_HUGETLB`
+ */
+#define VEC_HUGE_PAGE_SIZE ((size_t)2 << 20)
+#endif
+
+#ifndef VEC_SEG_BASE_LOG2
+/*!
+ * \brief Base-2 logarithm of the number of elements in the first segment of a
+ * segmented vector. Every following segment is twice as large as the last.
+ */
+#define VEC_SEG_BASE_LOG2 4
+#endif
+
+//! Number of segments needed to address every possible index.
+#define VEC_SEG_MAX (sizeof(size_t) * 8 - VEC_SEG_BASE_LOG2)
+
 #ifndef VEC_GROWTH_RATE
 /*!
  * \brief Rate at which a vector grows whenever a resize is needed
@@ -42,7 +127,66 @@
 #define VEC_GROWTH_RATE 3 / 2
 #endif
 
+#ifndef VEC_PREFETCH_DISTANCE
+/*!
+ * \brief Number of elements ahead of the current one that `vec_gather()` and
+ * `vec_scatter()` prefetch. 0 disables prefetching.
+ */
+#define VEC_PREFETCH_DISTANCE 16
+#endif
+
+#ifndef VEC_SORT_PARALLEL_MIN
+/*!
+ * \brief Length from which `vec_sort()` sorts through the job system (see
+ * `vec_parallel_for()`) instead of a single `qsort()`
+ */
+#define VEC_SORT_PARALLEL_MIN ((size_t)1 << 16)
+#endif
+
+/*!
+ * \def VEC_NO_SIMD
+ * \brief If defined, the typed kernels (`vec_find_i32()` and friends) only use
+ * their portable scalar implementations.
+ */
+
+/*!
+ * \def VEC_GROWTH_POW2
+ * \brief If defined, capacities picked when growing are rounded up to the next
+ * power of two instead of following `VEC_GROWTH_RATE`. This keeps heap blocks
+ * aligned with the size classes of most general purpose allocators.
+ */
+
 #include <stddef.h>
+#include <stdint.h>
+
+// Alignment that `malloc()` guarantees. `struct vec_meta_t` is padded to it so
+// that the first element of a default vector is as aligned as a `malloc()`
+// block, whatever fields the header has.
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define __VEC_MAX_ALIGN _Alignof(max_align_t)
+#else
+union __vec_max_align_u {
+  long double ld;
+  long long ll;
+  double d;
+  void *p;
+  void (*fn)(void);
+};
+struct __vec_max_align_probe {
+  char c;
+  union __vec_max_align_u u;
+};
+#define __VEC_MAX_ALIGN offsetof(struct __vec_max_align_probe, u)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define __vec_meta_align __attribute__((aligned(__VEC_MAX_ALIGN)))
+#elif defined(_MSC_VER)
+// `max_align_t` is `double` with MSVC.
+#define __vec_meta_align __declspec(align(8))
+#else
+#define __vec_meta_align
+#endif
 
 typedef void *vec_t;
 typedef void *svec_t;
@@ -52,6 +196,12 @@ typedef enum {
 
   VEC_ERR_OOM = -1,
 
+  VEC_ERR_OUT_OF_BOUNDS = -2,
+
+  VEC_ERR_IO = -3,
+
+  VEC_ERR_SHARED = -4,
+
 } vec_error_t;
 
 /*!
@@ -94,8 +244,267 @@ typedef void (*elem_copy)(void *dst, const void *src);
  */
 typedef void (*elem_destr)(void *d);
 
+/*!
+ * \brief Signature of a function that copies a range of elements from one
+ * address to another.
+ * \details For copying elements of type `T`, an equivalent signature should be:
+ * ```
+ * void T_copy_n(T *dst, const T *src, size_t n)
+ * ```
+ * \param dst Address at which the first element should be copied
+ * \param src Address of the first element that should be copied
+ * \param n Number of elements that should be copied
+ */
+typedef void (*elem_copy_n)(void *dst, const void *src, size_t n);
+
+/*!
+ * \brief Signature of a function that relocates data from one address to
+ * another.
+ * \details After the call, `dst` owns everything that `src` owned, and `src`
+ * is treated as uninitialized memory that is not destroyed. For relocating
+ * elements of type `T`, an equivalent signature should be:
+ * ```
+ * void T_move(T *dst, T *src)
+ * ```
+ * Only types that are not trivially relocatable (e.g. types holding pointers
+ * into themselves) need one; all other types are relocated using memcpy.
+ * \param dst Address at which the data should be relocated
+ * \param src Address from which the data should be relocated
+ */
+typedef void (*elem_move)(void *dst, void *src);
+
+/*!
+ * \brief Set of functions that a vector uses to acquire and release its memory.
+ * \details Every function receives the allocator's `ctx` as its first
+ * argument. Sizes passed to `realloc_fn` and `free_fn` are the sizes of the
+ * blocks as they were last requested, which allows size-aware allocators
+ * (arenas, pools) to work without storing any bookkeeping of their own.
+ *
+ * Sample usage:
+ * ```
+ * vec_allocator_t my_alloc = {
+ *   .alloc_fn   = my_alloc_fn,
+ *   .realloc_fn = my_realloc_fn,
+ *   .free_fn    = my_free_fn,
+ *   .ctx        = &my_state,
+ * };
+ * vec(int) v = vec_init_w_allocator(int, &my_alloc);
+ * ```
+ */
+typedef struct vec_allocator_t {
+  //! Allocates a block of `size` bytes, aligned like a `malloc()` block.
+  //! Returns NULL on failure.
+  void *(*alloc_fn)(void *ctx, size_t size);
+  //! Resizes the block `ptr` from `old_size` to `new_size` bytes, with the
+  //! same alignment as `alloc_fn`. Returns NULL on failure, in which case
+  //! `ptr` is left untouched.
+  void *(*realloc_fn)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+  //! Releases the block `ptr` of `size` bytes.
+  void (*free_fn)(void *ctx, void *ptr, size_t size);
+  //! User data that is passed to every function of the allocator.
+  void *ctx;
+} vec_allocator_t;
+
+//! Policies that decide when a vector gives unused capacity back.
+typedef enum {
+  //! Capacity is only ever reduced explicitly.
+  VEC_SHRINK_NONE = 0,
+  //! When the length falls below a quarter of the capacity, the capacity is
+  //! halved (never below `VEC_INIT_CAP`).
+  VEC_SHRINK_HYSTERESIS,
+} vec_shrink_policy_t;
+
+/*!
+ * \def VEC_STATS
+ * \brief If defined, vectors record counters about their allocation and growth
+ * behavior (see `vec_stats_get()`). Since this changes the layout of
+ * `struct vec_meta_t`, it must be defined in every translation unit that
+ * includes this header.
+ */
+#ifdef VEC_STATS
+//! Counters recorded for a single vector, or for all vectors combined.
+typedef struct vec_stats_t {
+  //! Number of elements added through `vec_push()`, `vec_append()` and friends.
+  size_t pushes;
+  //! Number of times the capacity was increased.
+  size_t grows;
+  //! Number of reallocations that moved the vector to a new block.
+  size_t realloc_moves;
+  //! Number of reallocations that resized the vector's block in place.
+  size_t inplace_extends;
+  //! Bytes copied by reallocations that moved the vector.
+  size_t bytes_moved;
+  //! Highest length that was reached.
+  size_t peak_length;
+  //! Highest capacity that was reached.
+  size_t peak_capacity;
+  //! Bytes of reserved but unused capacity at the time of the query. Only
+  //! reported for single vectors.
+  size_t wasted_bytes;
+} vec_stats_t;
+#endif
+
+/*!
+ * \def VEC_COMPACT_META
+ * \brief If defined, `struct vec_meta_t` is packed into 32 bytes (on 64-bit
+ * targets): lengths and capacities are 32-bit, the element size and flags
+ * share a word, and the element functions and allocator move into a shared
+ * `vec_type_t`. This is meant for programs that keep huge numbers of small
+ * vectors. Lengths are limited to `VEC_MAX_CAPACITY` and element sizes to
+ * `VEC_MAX_ELEMSIZE`. Like `VEC_STATS`, it must be defined in every
+ * translation unit that includes this header.
+ */
+#ifdef VEC_COMPACT_META
+//! Largest capacity that a vector can have.
+#define VEC_MAX_CAPACITY ((size_t)UINT32_MAX)
+//! Largest element size (in bytes) that a vector can have.
+#define VEC_MAX_ELEMSIZE (((size_t)1 << 24) - 1)
+//! Largest alignment (in bytes) that a vector can have.
+#define VEC_MAX_ALIGNMENT ((size_t)1 << 15)
+//! Largest distance (in bytes) between the start of a block and the first element.
+#define VEC_MAX_OFFSET ((size_t)UINT16_MAX)
+#else
+#define VEC_MAX_CAPACITY ((size_t)-1)
+#define VEC_MAX_ELEMSIZE ((size_t)-1)
+#define VEC_MAX_ALIGNMENT ((size_t)-1 / 2 + 1)
+#define VEC_MAX_OFFSET ((size_t)-1)
+#endif
+
+/*!
+ * \brief Element functions and allocator of a vector.
+ * \details Vectors can be initialized from a descriptor with
+ * `vec_init_w_type()`. With `VEC_COMPACT_META`, vectors only keep a pointer
+ * to their descriptor, so one descriptor can be shared by any number of
+ * vectors of the same type.
+ */
+typedef struct vec_type_t {
+  //! If set, the vector uses this function to copy new values into the vector.
+  elem_copy copy_fn;
+  //! If set, the vector uses this function to destroy stored values.
+  elem_destr destr_fn;
+  //! If set, the vector uses this function to copy ranges of new values into the vector.
+  elem_copy_n copy_n_fn;
+  //! If set, the vector uses this function to relocate stored values.
+  elem_move move_fn;
+  //! The allocator that owns the vector's memory. NULL for the default allocator.
+  const vec_allocator_t *allocator;
+} vec_type_t;
+
+typedef enum {
+    VEC_ALLOCATION_TYPE_STACK,
+    VEC_ALLOCATION_TYPE_HEAP,
+    //! Lives in stack or caller-provided storage and moves to the heap
+    //! the first time it outgrows it.
+    VEC_ALLOCATION_TYPE_INLINE,
+    //! Lives in a reserved range of virtual memory whose pages are
+    //! committed as the vector grows. Never moves.
+    VEC_ALLOCATION_TYPE_RESERVED,
+    //! Maps a file saved with `vec_save()` and moves to the heap the first
+    //! time it outgrows it.
+    VEC_ALLOCATION_TYPE_MAPPED
+} vec_allocation_type_t;
+
+/*!
+ * \def VEC_API_CHECK
+ * \brief If defined, every function of the implementation checks the vector it
+ * is given before using it: that it is a live vector (a magic number is
+ * stored in `struct vec_meta_t` and cleared by `vec_fini()`), and that its
+ * length does not exceed its capacity. Slots that are vacated by pops,
+ * removals, `vec_setlen()`, `vec_clear()` and `vec_fini()` are overwritten
+ * with `VEC_POISON_BYTE` so that stale pointers read garbage instead of
+ * plausible values. Failures are reported to the function set with
+ * `vec_set_check_fn()`. The layout of `struct vec_meta_t` is the same either
+ * way, but vectors created without the checks have no magic number, so it
+ * must be defined in every translation unit that includes this header.
+ * Without it, none of the checks are compiled in.
+ */
+
+#ifndef VEC_POISON_BYTE
+/*!
+ * \brief Byte that vacated slots are filled with when `VEC_API_CHECK` is defined
+ */
+#define VEC_POISON_BYTE 0xDD
+#endif
+
+//! Magic number of a live vector.
+#define __VEC_MAGIC_LIVE 0x5645434cu
+//! Magic number of a vector that was passed to `vec_fini()`.
+#define __VEC_MAGIC_DEAD 0x56454344u
+
+#ifdef VEC_API_CHECK
+#define __VEC_SVEC_MAGIC .meta.magic = __VEC_MAGIC_LIVE,
+#else
+#define __VEC_SVEC_MAGIC
+#endif
+
+/*!
+ * \brief Signature of a function that is called when a check of
+ * `VEC_API_CHECK` fails.
+ * \details If the function returns, the operation goes on as if the check had
+ * passed.
+ * \param func Name of the function that detected the failure
+ * \param msg Description of the failure
+ * \param v The vector object that failed the check
+ */
+typedef void (*vec_check_fn)(const char *func, const char *msg, const void *v);
+
+/*!
+ * \brief Sets the function that failed checks are reported to (see
+ * `VEC_API_CHECK`). The default one prints the failure to `stderr` and
+ * aborts.
+ *
+ * *Note*: This is a process-wide setting and is not synchronized; it is meant
+ * to be set once at startup.
+ *
+ * \param fn The report function. If NULL, the default one is restored.
+ *
+ * \returns The report function that was set before
+ */
+VEC_API vec_check_fn
+vec_set_check_fn(
+  vec_check_fn fn);
+
 //! Metadata that is stored with a vector. Unique to each vector.
-struct vec_meta_t {
+#ifdef VEC_COMPACT_META
+struct __vec_meta_align vec_meta_t {
+  //! The number of elements in the vector.
+  uint32_t length;
+  //! The maximum length of the vector before it needs to be resized.
+  uint32_t capacity;
+  //! The size (in bytes) of memory that each element takes.
+  unsigned elemsize : 24;
+  //! A `vec_allocation_type_t`.
+  unsigned allocationType : 4;
+  //! A `vec_shrink_policy_t`.
+  unsigned shrink_policy : 3;
+  //! Alignment (in bytes) of the first element. 0 if no alignment was requested.
+  uint16_t alignment;
+  //! Distance (in bytes) between the start of the allocated block and the first element.
+  uint16_t offset;
+  //! Element functions and allocator. NULL if the vector has none of them.
+  const vec_type_t *type;
+
+#ifdef VEC_STATS
+  //! Counters of this vector.
+  vec_stats_t stats;
+#endif
+  //! Number of other handles that own the buffer too, 0 if it is private.
+  //! Only accessed atomically. See `vec_share()`.
+  uint32_t shared;
+  //! `__VEC_MAGIC_LIVE` until the vector is destroyed, if `VEC_API_CHECK` is
+  //! defined. Unused otherwise, but always there so that the checks do not
+  //! change the layout. Last, so that it is the first field to be hit when
+  //! writing before the first element.
+  uint32_t magic;
+};
+
+#define __vec_meta_copy_fn(m)   ((m)->type ? (m)->type->copy_fn : (elem_copy)0)
+#define __vec_meta_destr_fn(m)  ((m)->type ? (m)->type->destr_fn : (elem_destr)0)
+#define __vec_meta_copy_n_fn(m) ((m)->type ? (m)->type->copy_n_fn : (elem_copy_n)0)
+#define __vec_meta_move_fn(m)   ((m)->type ? (m)->type->move_fn : (elem_move)0)
+#define __vec_meta_allocator(m) ((m)->type ? (m)->type->allocator : (const vec_allocator_t *)0)
+#else
+struct __vec_meta_align vec_meta_t {
   //! The number of elements in the vector.
   size_t length;
   //! The maximum length of the vector before it needs to be resized.
@@ -103,17 +512,57 @@ struct vec_meta_t {
   //! The size (in bytes) of memory that each element takes.
   size_t elemsize;
 
-  enum {
-      VEC_ALLOCATION_TYPE_STACK,
-      VEC_ALLOCATION_TYPE_HEAP
-  } allocationType;
+  //! Where the vector's memory comes from.
+  vec_allocation_type_t allocationType;
+  //! Decides whether removing elements shrinks the capacity.
+  vec_shrink_policy_t shrink_policy;
 
   //! If set, the vector uses this function to copy new values into the vector.
   elem_copy copy_fn;
   //! If set, the vector uses this function to destroy stored values.
   elem_destr destr_fn;
+  //! If set, the vector uses this function to copy ranges of new values into the vector.
+  elem_copy_n copy_n_fn;
+  //! If set, the vector uses this function to relocate stored values.
+  elem_move move_fn;
+
+  //! The allocator that owns the vector's memory. NULL for stack-allocated vectors.
+  const vec_allocator_t *allocator;
+
+  //! Alignment (in bytes) of the first element. 0 if no alignment was requested.
+  size_t alignment;
+  //! Distance (in bytes) between the start of the allocated block and the first element.
+  size_t offset;
+
+#ifdef VEC_STATS
+  //! Counters of this vector.
+  vec_stats_t stats;
+#endif
+
+  //! Number of other handles that own the buffer too, 0 if it is private.
+  //! Only accessed atomically. See `vec_share()`.
+  uint32_t shared;
+  //! `__VEC_MAGIC_LIVE` until the vector is destroyed, if `VEC_API_CHECK` is
+  //! defined. Unused otherwise, but always there so that the checks do not
+  //! change the layout. Last, so that it is the first field to be hit when
+  //! writing before the first element.
+  uint32_t magic;
 };
 
+#define __vec_meta_copy_fn(m)   ((m)->copy_fn)
+#define __vec_meta_destr_fn(m)  ((m)->destr_fn)
+#define __vec_meta_copy_n_fn(m) ((m)->copy_n_fn)
+#define __vec_meta_move_fn(m)   ((m)->move_fn)
+#define __vec_meta_allocator(m) ((m)->allocator)
+#endif
+
+// Nonzero if other handles own the buffer of the metadata `m` too.
+#if defined(__GNUC__) || defined(__clang__)
+#define __vec_is_shared(m) __atomic_load_n(&(m)->shared, __ATOMIC_ACQUIRE)
+#else
+#define __vec_is_shared(m) (*(const volatile uint32_t *)&(m)->shared)
+#endif
+
 /*!
  * \param elemsize Memory (in bytes) that should be reserved per element in the vector
  * \param copy A function pointer to the function that should be used to copy an element
@@ -130,529 +579,7400 @@ vec_init_impl(
   elem_destr destr);
 
 /*!
- * \brief Syntactic sugar for `vec_init_impl()`
- * \details Sample usage:
- * ```
- * vec_init(int);                   // vec_init_impl(sizeof(int), NULL, NULL);
- * vec_init(int, fn_destr);         // vec_init_impl(sizeof(int), NULL, fn_destr);
- * vec_init(int, fn_cpy, fn_destr); // vec_init_impl(sizeof(int), fn_cpy, fn_destr);
- * ```
+ * \brief Same as `vec_init_impl()` but the vector's memory is managed by
+ * `allocator` for its whole lifetime.
+ *
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ * \param allocator The allocator that should be used by the vector. It must
+ * outlive the vector. If NULL, the default allocator is used.
+ *
+ * \returns A vector object
  */
-#define __vec_vargs_narg(...) __vec_vargs_narg_impl(__VA_ARGS__, __vec_vargs_rseq_n())
-#define __vec_vargs_narg_impl(...) __vec_vargs_arg_n(__VA_ARGS__)
-#define __vec_vargs_arg_n(_1, _2, _3, N, ...) N
-#define __vec_vargs_rseq_n() 3, 2, 1, 0
-
-#define __vec_cat_impl(a,b) a##b
-#define __vec_cat(a,b) __vec_cat_impl(a,b)
-
-#define __vec_arr_size(...) sizeof(__VA_ARGS__)/sizeof((__VA_ARGS__)[0])
-
-#define vec_init(...) __vec_cat(__vec_init_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
-#define __vec_init_1(type) vec_init_impl(sizeof(type), NULL, NULL)
-#define __vec_init_2(type, destr) vec_init_impl(sizeof(type), NULL, destr)
-#define __vec_init_3(type, cpy, destr) vec_init_impl(sizeof(type), cpy, destr)
-
-#define svec_init(type, ...) __svec_init_impl(type, __vec_arr_size((type[])__VA_ARGS__), __VA_ARGS__)
-#define svec_init_w_cap(type, cap) __svec_init_w_cap_impl(type, cap)
-
-#define __svec_init_impl(type, size, ...)                                 \
-		(svec(type))&((struct {                                           \
-		  struct vec_meta_t meta;                                         \
-	 	  type data[size];                                                \
-	    }) {                                                              \
-	  	  .meta.length = size,                                            \
-	  	  .meta.capacity = size,                                          \
-	  	  .meta.elemsize = sizeof(type),                                  \
-	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,            \
-          .meta.copy_fn = 0,                                              \
-          .meta.destr_fn = 0,                                             \
-	  	  .data = __VA_ARGS__                                             \
-	    }).data
-
-#define __svec_init_w_cap_impl(type, cap)                               \
-		(svec(type))&((struct {                                                       \
-		  struct vec_meta_t meta;                                         \
-	 	  type data[cap];                                                \
-	    }) {                                                              \
-	  	  .meta.length = 0,                                               \
-	  	  .meta.capacity = cap,                                          \
-	  	  .meta.elemsize = sizeof(type),                                  \
-	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,            \
-          .data = { 0 }                                                   \
-	    }).data
+VEC_API vec_t
+vec_init_w_allocator_impl(
+  size_t elemsize, 
+  elem_copy copy, 
+  elem_destr destr,
+  const vec_allocator_t *allocator);
 
 /*!
- * \param v The vector that we want an iterator for
+ * \brief Same as `vec_init_w_allocator_impl()` but the first element of the
+ * vector is placed at an address that is a multiple of `alignment`. The
+ * alignment is preserved across every reallocation of the vector.
  *
- * \returns A pointer to the first element in a vector
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param alignment Alignment (in bytes) of the vector's data. Must be a power
+ * of two. If 0, the vector is not padded.
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ * \param allocator The allocator that should be used by the vector. It must
+ * outlive the vector. If NULL, the default allocator is used.
+ *
+ * \returns A vector object. NULL if `alignment` is not a power of two.
  */
-VEC_API void *
-vec_iter_begin(
-  vec_t v);
+VEC_API vec_t
+vec_init_aligned_impl(
+  size_t elemsize, 
+  size_t alignment,
+  elem_copy copy, 
+  elem_destr destr,
+  const vec_allocator_t *allocator);
 
 /*!
- * \param v The vector that we want an iterator for
+ * \brief Initializes a vector with the element functions and allocator of a
+ * type descriptor. With `VEC_COMPACT_META`, the vector keeps a pointer to
+ * `type` instead of a copy, so `type` must outlive the vector.
  *
- * \returns A pointer to the memory block right after the last element in the vector
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param type Element functions and allocator of the vector
+ *
+ * \returns A vector object
  */
-VEC_API void *
-vec_iter_end(
-  vec_t v);
+VEC_API vec_t
+vec_init_w_type_impl(
+  size_t elemsize, 
+  const vec_type_t *type);
 
 /*!
- * \brief A function that increments an iterator to make it point to the next
- * element in the vector
+ * \brief Initializes a vector inside caller-provided storage. The vector
+ * behaves like a heap vector, except that no memory is allocated until it
+ * outgrows `buffer`, at which point its elements are moved to a block from the
+ * default allocator. `buffer` is never freed by the vector and must outlive it
+ * (or at least live until it spills to the heap).
  *
- * \param v The vector that is being iterated over
- * \param iter Reference to the iterator that is being incremented
+ * \param buffer Storage for the vector's header and elements
+ * \param size Size (in bytes) of `buffer`
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ *
+ * \returns A vector object. NULL if `buffer` cannot hold the vector's header.
  */
-VEC_API void
-vec_iter_next(
-  vec_t v, 
-  void **iter);
+VEC_API vec_t
+vec_init_w_storage_impl(
+  void *buffer,
+  size_t size,
+  size_t elemsize, 
+  elem_copy copy, 
+  elem_destr destr);
 
-#define vec_foreach(ref, vec) \
-  for(ref = vec_iter_begin(vec); (void*)ref < vec_iter_end(vec); vec_iter_next(vec, (void**)&ref))
+//! Flags of `vec_init_reserved_impl()`.
+typedef enum vec_reserve_flags_t {
+  VEC_RESERVE_NONE = 0,
+  //! Asks for transparent huge pages with `madvise(MADV_HUGEPAGE)`.
+  VEC_RESERVE_THP = 1 << 0,
+  //! Backs the vector with explicit huge pages (`MAP_HUGETLB`) of
+  //! `VEC_HUGE_PAGE_SIZE` bytes. The whole reservation must fit in the huge
+  //! page pool, otherwise normal pages are used.
+  VEC_RESERVE_HUGETLB = 1 << 1,
+} vec_reserve_flags_t;
 
 /*!
- * \brief A function that destroys a vector object. If a destructor function was
- * passed while initializing the vector, then this function is called on every
- * element before all reserved memory is freed.
+ * \brief Initializes a vector inside a reserved range of virtual memory that
+ * can hold up to `max_capacity` elements. Only the pages that are needed for
+ * the current capacity are committed; growing commits more pages in place, so
+ * elements are never copied and pointers to them stay valid. Shrinking the
+ * capacity hands the unused pages back to the system.
  *
- * *Note*: For stack-allocated vectors (`svec`), destructors are called for 
- * elements but no memory is freed.
+ * *Note*: Growing beyond `max_capacity` fails with `VEC_ERR_OOM`. Requires
+ * `mmap()` with `MAP_ANONYMOUS` (on glibc, define `_DEFAULT_SOURCE` when
+ * compiling with a strict `-std=` mode) or `VirtualAlloc()`. Huge page flags
+ * are ignored on Windows.
  *
- * \param v The vector that is being destroyed
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param max_capacity Number of elements that the reservation should fit
+ * \param flags A combination of `vec_reserve_flags_t`
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ *
+ * \returns A vector object. NULL if the address range could not be reserved
+ * or virtual memory is not supported on this platform.
  */
-VEC_API void
-vec_fini(
-  vec_t v);
+VEC_API vec_t
+vec_init_reserved_impl(
+  size_t elemsize,
+  size_t max_capacity,
+  int flags,
+  elem_copy copy, 
+  elem_destr destr);
+
+//! Flags of `vec_map_file_impl()`.
+typedef enum vec_map_flags_t {
+  VEC_MAP_NONE = 0,
+  //! Reads the whole file in while mapping it instead of faulting pages in
+  //! on first access (`MAP_POPULATE`). Ignored where unsupported.
+  VEC_MAP_POPULATE = 1 << 0,
+  //! Hints that the elements will be read front to back.
+  VEC_MAP_SEQUENTIAL = 1 << 1,
+} vec_map_flags_t;
 
 /*!
- * \brief A function that copies a value to the end of a vector. If a copy
- * function was passed while initializing the vector, then this function is
- * called to copy the new element into the vector. Otherwise, memcpy is used
- * with a length of `vec_meta.elemsize`. If a resize is needed but fails due to
- * 'OOM' issues, then the vector is left unchanged and VEC_ERR_OOM is returned.
+ * \brief Maps a file that was written by `vec_save()` and returns it as a
+ * vector. Nothing is read up front; pages are loaded as they are accessed.
+ * The mapping is private: the vector can be modified, but changes are never
+ * written back to the file. When it outgrows the file, the vector is moved to
+ * a block from the default allocator.
  *
- * For `svec`, as long as the capacity is more than the current size, a push
- * operation is permitted. Otherwise, the operation is treated as an OOM.
+ * *Note*: Elements are loaded bit for bit, so element types must not contain
+ * pointers. The vector has no copy or destroy functions.
  *
- * \param v Reference to the vector object
- * \param val A pointer to the element that is to be copied to the end of the
- * vector
+ * \param path Path of the file
+ * \param elemsize Size (in bytes) of each element. Must match the saved vector
+ * \param flags A combination of `vec_map_flags_t`
  *
- * \returns The index of the element that was just pushed. If the operation
- * failed, a non-zero (vec_error_t) value is returned.
+ * \returns A vector object. NULL if the file could not be mapped or was not
+ * written by `vec_save()` for elements of `elemsize` bytes. Files whose data
+ * does not start on a cache line, or starts further than `VEC_MAX_OFFSET`
+ * bytes in, are rejected as well.
  */
-VEC_API int
-vec_push(
-  vec_t *v, 
-  void *val);
+VEC_API vec_t
+vec_map_file_impl(
+  const char *path,
+  size_t elemsize,
+  int flags);
 
 /*!
- * \brief A function that appends the elements of an array to the end of a
- * vector.  If a resize is needed but fails due to 'OOM' issues, then the
- * vector is left unchanged and a VEC_ERR_OOM is returned.
+ * \brief Writes the vector to `path` in the format that `vec_map_file()`
+ * expects: a header, followed by the elements as one contiguous block.
  *
- * For `svec`, as long as the capacity is more than the current size by the
- * desired amount, an append operation is permitted. Otherwise, the operation 
- * is treated as an OOM.
+ * \param v The vector object
+ * \param path Path of the file. Existing files are overwritten
  *
- * *NOTE* The vector's copy function is not used; this is merely a memcpy
- * operation. If a deep copy is needed, individually pushing the elements of
- * the array is the way to go.
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_IO` if the file could not be
+ * written
+ */
+VEC_API vec_error_t
+vec_save(
+  vec_t v,
+  const char *path);
+
+/*!
+ * \brief Sets the allocator that is used by vectors initialized without an
+ * explicit allocator. Vectors keep the allocator they were initialized with,
+ * so changing the default does not affect already existing vectors.
  *
- * \param v Reference to the vector object
- * \param arr A pointer to the array that is to be copied to the end of the
- * vector
- * \param size Number of elements in the array
+ * *Note*: This is a process-wide setting and is not synchronized; it is meant
+ * to be set once at startup.
  *
- * \returns The index of the first element that was appended to the vector. If 
- * the operation failed, a non-zero (vec_error_t) value is returned.
+ * \param allocator The new default allocator. If NULL, the built-in
+ * `malloc`/`realloc`/`free` allocator is restored.
  */
-VEC_API int
-vec_append(
-  vec_t *v,
-  void **arr,
-  size_t size);
+VEC_API void
+vec_set_default_allocator(
+  const vec_allocator_t *allocator);
 
 /*!
- * \brief A function that copies the value at the end of a vector and removes
- * it from the vector. If a copy function was passed while initializing the 
- * vector, then this function is used. Otherwise, memcpy is used with a length 
- * of `vec_meta.elemsize`
- *
- * \param v Reference to the vector object
- * \param out A pointer to the memory block at which the popped element will be
- * copied. If NULL is passed, then the element is destructed. Otherwise, the
- * element is copied to `out` and the receiving code is responsible for its
- * destruction.
- * 
- * \returns An error code. If the operation was successful, then `VEC_ERR_NONE` 
- * is returned.
+ * \returns The allocator that is currently used by default
  */
-VEC_API vec_error_t
-vec_pop(
-  vec_t *v, 
-  void *out);
+VEC_API const vec_allocator_t *
+vec_get_default_allocator(void);
 
 /*!
- * \brief A function that returns the last element in the vector.
+ * \brief Linear allocator that vectors can be created into.
+ * \details Blocks are bumped out of a single buffer and are only given back
+ * all at once through `vec_arena_reset()`. The most recent allocation can grow
+ * and shrink in place, so a vector that is the last one created in the arena
+ * never needs to be copied when it grows.
  *
- * \param v Reference to the vector object
- * 
- * \returns Pointer to the last element in the vector. NULL if the vector is
- * empty.
+ * Sample usage:
+ * ```
+ * vec_arena_t frame;
+ * vec_arena_init(&frame, NULL, 1 << 20);
+ * vec(int) v = vec_init_w_allocator(int, vec_arena_allocator(&frame));
+ * ...
+ * vec_arena_reset(&frame); // `v` and every other vector in the arena are gone
+ * ```
  */
-VEC_API void *
-vec_last(
-    vec_t v);
+typedef struct vec_arena_t {
+  //! Allocator interface that forwards to the arena.
+  vec_allocator_t allocator;
+  //! Memory that blocks are allocated from.
+  char *buffer;
+  //! Size (in bytes) of `buffer`.
+  size_t size;
+  //! Offset of the first free byte in `buffer`.
+  size_t offset;
+  //! The most recently allocated block. NULL if it was freed or the arena was reset.
+  char *last;
+  //! The allocator that `buffer` was allocated from by the arena itself.
+  //! NULL if the buffer was provided by the caller.
+  const vec_allocator_t *backing;
+} vec_arena_t;
 
 /*!
- * \brief A function that returns the length of a vector
+ * \brief Initializes an arena.
  *
- * \param v The vector object
+ * \param arena The arena object to initialize
+ * \param buffer Memory that the arena should allocate from. If NULL, `size`
+ * bytes are requested from the default allocator and released by
+ * `vec_arena_fini()`.
+ * \param size Size (in bytes) of the memory that the arena manages
  *
- * \returns Current length of the vector
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the buffer could not
+ * be allocated
  */
-VEC_API size_t
-vec_len(
-  vec_t v);
+VEC_API vec_error_t
+vec_arena_init(
+  vec_arena_t *arena,
+  void *buffer,
+  size_t size);
 
 /*!
- * \brief A function that returns the capacity of a vector
+ * \brief Releases every block allocated from the arena in O(1).
  *
- * \param v The vector object
+ * *Note*: Vectors that live in the arena must not be used afterwards, and
+ * their destructors are not called. Vectors with a destructor should be
+ * passed to `vec_fini()` before the reset.
  *
- * \returns Current capacity of the vector
+ * \param arena The arena object
  */
-VEC_API size_t
-vec_capacity(
-  vec_t v);
+VEC_API void
+vec_arena_reset(
+  vec_arena_t *arena);
 
 /*!
- * \brief Calls the free operation (if exists) on every element, then sets
- * the length to 0.
- *
- * \param v The vector object
+ * \brief Resets the arena and releases its buffer if it was allocated by
+ * `vec_arena_init()`.
  *
- * \returns 0 on success
+ * \param arena The arena object
  */
-VEC_API int
-vec_clear(
-  vec_t v);
+VEC_API void
+vec_arena_fini(
+  vec_arena_t *arena);
 
 /*!
- * \brief Sets the length of the vector to `len`.
- *
- * \details If `len` is less than `v`'s current length, then `v`'s length is
- * amended. Otherwise, the capacity is checked to make sure that there is enough
- * space for the new len.
- *
- * For `svec`, if the `len` is more than the already allocated capacity, it is
- * treated as an OOM.
+ * \param arena The arena object
  *
- * \param v Reference to the vector object
- * \param len The desired new length
- *
- * \returns `VEC_ERR_NONE` on success
+ * \returns The allocator interface of the arena, to be passed to
+ * `vec_init_w_allocator()`
  */
-VEC_API vec_error_t
-vec_setlen(
-  vec_t *v, 
-  size_t len);
+VEC_API const vec_allocator_t *
+vec_arena_allocator(
+  vec_arena_t *arena);
 
 /*!
- * \brief Sets the capacity of the vector to `cap`.
+ * \brief Allocator that recycles the blocks of vectors that are created and
+ * destroyed over and over.
+ * \details Requests are rounded up to a power-of-two size class, from
+ * `VEC_POOL_MIN_BLOCK` up to `VEC_POOL_CLASSES` classes, and freed blocks are
+ * kept for the next request of the same class. Every thread caches up to
+ * `VEC_POOL_CACHE_MAX` blocks per class without any synchronization; beyond
+ * that the least recently freed half moves to a lock-free global list, which
+ * threads with an empty cache take blocks from. A reallocation within the same
+ * class returns the block unchanged. Blocks above the largest class, and
+ * blocks that are needed but not cached, come from `malloc()`.
  *
- * \param v Reference to the vector object
- * \param cap The desired new capacity
- *
- * For stack-allocated vectors, `VEC_ERR_OOM` is returned
+ * Sample usage:
+ * ```
+ * vec_set_default_allocator(vec_pool_allocator()); // Or define VEC_POOL_DEFAULT
+ * vec(int) v = vec_init(int);                      // Recycled by vec_fini()
+ * ```
  *
- * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ * \returns The pool allocator interface, to be passed to
+ * `vec_init_w_allocator()` or `vec_set_default_allocator()`
  */
-VEC_API vec_error_t
-vec_setcapacity(
-  vec_t *v, 
-  size_t cap);
+VEC_API const vec_allocator_t *
+vec_pool_allocator(void);
 
 /*!
- * \brief Grows the vector's capacity by a factor of `VEC_GROWTH_RATE`
- *
- * \param Reference to the vector object
- *
- * \returns `VEC_ERR_NONE` on success
+ * \brief Hands every block cached by the calling thread over to the global
+ * lists. Threads that used the pool should call it before they exit, otherwise
+ * their cached blocks are lost.
  */
-VEC_API vec_error_t
-vec_grow(
-  vec_t *v);
+VEC_API void
+vec_pool_flush(void);
 
-#ifdef VEC_IMPLEMENTATION
-#undef VEC_IMPLEMENTATION
+/*!
+ * \brief Gives the blocks cached by the calling thread and the blocks in the
+ * global lists back to `free()`. Blocks cached by other threads are kept.
+ */
+VEC_API void
+vec_pool_trim(void);
 
-#ifdef VEC_API_CHECK
-#define API_CHECK(x) do { x; } while(0)
+/*!
+ * \brief Syntactic sugar for `vec_init_impl()`
+ * \details Sample usage:
+ * ```
+ * vec_init(int);                   // vec_init_impl(sizeof(int), NULL, NULL);
+ * vec_init(int, fn_destr);         // vec_init_impl(sizeof(int), NULL, fn_destr);
+ * vec_init(int, fn_cpy, fn_destr); // vec_init_impl(sizeof(int), fn_cpy, fn_destr);
+ * ```
+ */
+#define __vec_vargs_narg(...) __vec_vargs_narg_impl(__VA_ARGS__, __vec_vargs_rseq_n())
+#define __vec_vargs_narg_impl(...) __vec_vargs_arg_n(__VA_ARGS__)
+#define __vec_vargs_arg_n(_1, _2, _3, _4, _5, N, ...) N
+#define __vec_vargs_rseq_n() 5, 4, 3, 2, 1, 0
+
+#define __vec_cat_impl(a,b) a##b
+#define __vec_cat(a,b) __vec_cat_impl(a,b)
+
+#define __vec_arr_size(...) sizeof(__VA_ARGS__)/sizeof((__VA_ARGS__)[0])
+
+#define vec_init(...) __vec_cat(__vec_init_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
+#define __vec_init_1(type) vec_init_impl(sizeof(type), NULL, NULL)
+#define __vec_init_2(type, destr) vec_init_impl(sizeof(type), NULL, destr)
+#define __vec_init_3(type, cpy, destr) vec_init_impl(sizeof(type), cpy, destr)
+
+/*!
+ * \brief Syntactic sugar for `vec_init_w_allocator_impl()`
+ * \details Sample usage:
+ * ```
+ * vec_init_w_allocator(int, a);                   // vec_init_w_allocator_impl(sizeof(int), NULL, NULL, a);
+ * vec_init_w_allocator(int, a, fn_destr);         // vec_init_w_allocator_impl(sizeof(int), NULL, fn_destr, a);
+ * vec_init_w_allocator(int, a, fn_cpy, fn_destr); // vec_init_w_allocator_impl(sizeof(int), fn_cpy, fn_destr, a);
+ * ```
+ */
+#define vec_init_w_allocator(...) __vec_cat(__vec_init_w_allocator_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
+#define __vec_init_w_allocator_2(type, alloc) vec_init_w_allocator_impl(sizeof(type), NULL, NULL, alloc)
+#define __vec_init_w_allocator_3(type, alloc, destr) vec_init_w_allocator_impl(sizeof(type), NULL, destr, alloc)
+#define __vec_init_w_allocator_4(type, alloc, cpy, destr) vec_init_w_allocator_impl(sizeof(type), cpy, destr, alloc)
+
+/*!
+ * \brief Syntactic sugar for `vec_init_aligned_impl()`
+ * \details Sample usage:
+ * ```
+ * vec_init_aligned(float, 64);                   // vec_init_aligned_impl(sizeof(float), 64, NULL, NULL, NULL);
+ * vec_init_aligned(float, 64, fn_destr);         // vec_init_aligned_impl(sizeof(float), 64, NULL, fn_destr, NULL);
+ * vec_init_aligned(float, 64, fn_cpy, fn_destr); // vec_init_aligned_impl(sizeof(float), 64, fn_cpy, fn_destr, NULL);
+ * ```
+ */
+#define vec_init_aligned(...) __vec_cat(__vec_init_aligned_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
+#define __vec_init_aligned_2(type, align) vec_init_aligned_impl(sizeof(type), align, NULL, NULL, NULL)
+#define __vec_init_aligned_3(type, align, destr) vec_init_aligned_impl(sizeof(type), align, NULL, destr, NULL)
+#define __vec_init_aligned_4(type, align, cpy, destr) vec_init_aligned_impl(sizeof(type), align, cpy, destr, NULL)
+
+/*!
+ * \brief Syntactic sugar for `vec_init_w_type_impl()`
+ * \details Sample usage:
+ * ```
+ * static const vec_type_t str_type = { .copy_fn = str_copy, .destr_fn = str_destr };
+ * vec(char *) v = vec_init_w_type(char *, &str_type); // vec_init_w_type_impl(sizeof(char *), &str_type);
+ * ```
+ */
+#define vec_init_w_type(type, desc) vec_init_w_type_impl(sizeof(type), desc)
+
+#define svec_init(type, ...) __svec_init_impl(type, __vec_arr_size((type[])__VA_ARGS__), __VA_ARGS__)
+#define svec_init_w_cap(type, cap) __svec_init_w_cap_impl(type, cap)
+
+/*!
+ * \brief Syntactic sugar for `vec_init_w_storage_impl()`
+ * \details Sample usage:
+ * ```
+ * char buf[256];
+ * vec_init_w_storage(int, buf, sizeof(buf));                   // vec_init_w_storage_impl(buf, sizeof(buf), sizeof(int), NULL, NULL);
+ * vec_init_w_storage(int, buf, sizeof(buf), fn_destr);         // vec_init_w_storage_impl(buf, sizeof(buf), sizeof(int), NULL, fn_destr);
+ * vec_init_w_storage(int, buf, sizeof(buf), fn_cpy, fn_destr); // vec_init_w_storage_impl(buf, sizeof(buf), sizeof(int), fn_cpy, fn_destr);
+ * ```
+ */
+#define vec_init_w_storage(...) __vec_cat(__vec_init_w_storage_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
+#define __vec_init_w_storage_3(type, buf, size) vec_init_w_storage_impl(buf, size, sizeof(type), NULL, NULL)
+#define __vec_init_w_storage_4(type, buf, size, destr) vec_init_w_storage_impl(buf, size, sizeof(type), NULL, destr)
+#define __vec_init_w_storage_5(type, buf, size, cpy, destr) vec_init_w_storage_impl(buf, size, sizeof(type), cpy, destr)
+
+/*!
+ * \brief Syntactic sugar for `vec_init_reserved_impl()`
+ * \details Sample usage:
+ * ```
+ * vec_init_reserved(int, 1 << 28, VEC_RESERVE_THP);                   // vec_init_reserved_impl(sizeof(int), 1 << 28, VEC_RESERVE_THP, NULL, NULL);
+ * vec_init_reserved(int, 1 << 28, VEC_RESERVE_THP, fn_destr);         // vec_init_reserved_impl(sizeof(int), 1 << 28, VEC_RESERVE_THP, NULL, fn_destr);
+ * vec_init_reserved(int, 1 << 28, VEC_RESERVE_THP, fn_cpy, fn_destr); // vec_init_reserved_impl(sizeof(int), 1 << 28, VEC_RESERVE_THP, fn_cpy, fn_destr);
+ * ```
+ */
+#define vec_init_reserved(...) __vec_cat(__vec_init_reserved_, __vec_vargs_narg(__VA_ARGS__))(__VA_ARGS__)
+#define __vec_init_reserved_3(type, max, flags) vec_init_reserved_impl(sizeof(type), max, flags, NULL, NULL)
+#define __vec_init_reserved_4(type, max, flags, destr) vec_init_reserved_impl(sizeof(type), max, flags, NULL, destr)
+#define __vec_init_reserved_5(type, max, flags, cpy, destr) vec_init_reserved_impl(sizeof(type), max, flags, cpy, destr)
+
+/*!
+ * \brief Syntactic sugar for `vec_map_file_impl()`
+ * \details Sample usage:
+ * ```
+ * vec(float) v = vec_map_file("points.vec", float, VEC_MAP_NONE); // vec_map_file_impl("points.vec", sizeof(float), VEC_MAP_NONE);
+ * ```
+ */
+#define vec_map_file(path, type, flags) vec_map_file_impl(path, sizeof(type), flags)
+
+/*!
+ * \brief Small-buffer vector with room for `cap` elements on the stack.
+ * \details Unlike `svec_init_w_cap()`, pushing past the capacity does not
+ * fail; the elements are moved to the heap instead. `vec_fini()` must be
+ * called, and only frees memory if the vector spilled.
+ * Sample usage:
+ * ```
+ * vec(int) v = svec_init_inline(int, 16);
+ * ```
+ */
+#define svec_init_inline(type, cap) __svec_init_inline_impl(type, cap)
+
+#define __svec_init_inline_impl(type, cap)                                \
+		(vec(type))&((struct {                                            \
+		  struct vec_meta_t meta;                                         \
+	 	  type data[cap];                                                 \
+	    }) {                                                              \
+	  	  __VEC_SVEC_MAGIC                                                \
+	  	  .meta.length = 0,                                               \
+	  	  .meta.capacity = cap,                                           \
+	  	  .meta.elemsize = sizeof(type),                                  \
+	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_INLINE,              \
+	    }).data
+
+/*!
+ * \brief Aligned counterparts of `svec_init()` and `svec_init_w_cap()`.
+ * \details `align` must be a power of two of at least 8 and a literal
+ * constant. The header is padded so that the first element is aligned.
+ * Sample usage:
+ * ```
+ * svec(float) a = svec_init_aligned(float, 32, { 1.f, 2.f, 3.f });
+ * svec(float) b = svec_init_w_cap_aligned(float, 64, 64);
+ * ```
+ */
+#define svec_init_aligned(type, align, ...) __svec_init_aligned_impl(type, align, __vec_arr_size((type[])__VA_ARGS__), __VA_ARGS__)
+#define svec_init_w_cap_aligned(type, cap, align) __svec_init_w_cap_aligned_impl(type, cap, align)
+
+#if defined(__GNUC__) || defined(__clang__)
+// No padding is needed when the header already ends on an `align` boundary.
+// Zero-length arrays are a GNU extension, hence `__extension__` on the
+// literals below.
+#define __svec_pad_size(align) (((align) - (sizeof(struct vec_meta_t) % (align))) % (align))
+#define __svec_extension __extension__
 #else
-#define API_CHECK(x)
+// Without zero-length arrays, a header that already ends on a boundary gets
+// a whole `align` of padding.
+#define __svec_pad_size(align) ((align) - (sizeof(struct vec_meta_t) % (align)))
+#define __svec_extension
 #endif
 
-#include <stdlib.h>
-#include <string.h>
+#define __svec_init_impl(type, size, ...)                                 \
+		(svec(type))&((struct {                                           \
+		  struct vec_meta_t meta;                                         \
+	 	  type data[size];                                                \
+	    }) {                                                              \
+	  	  __VEC_SVEC_MAGIC                                                \
+	  	  .meta.length = size,                                            \
+	  	  .meta.capacity = size,                                          \
+	  	  .meta.elemsize = sizeof(type),                                  \
+	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,            \
+	  	  .data = __VA_ARGS__                                             \
+	    }).data
 
-#define vec_meta(v) \
-  ((struct vec_meta_t *)v) - 1
+#define __svec_init_w_cap_impl(type, cap)                               \
+		(svec(type))&((struct {                                                       \
+		  struct vec_meta_t meta;                                         \
+	 	  type data[cap];                                                \
+	    }) {                                                              \
+	  	  __VEC_SVEC_MAGIC                                                \
+	  	  .meta.length = 0,                                               \
+	  	  .meta.capacity = cap,                                          \
+	  	  .meta.elemsize = sizeof(type),                                  \
+	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,            \
+	    }).data
 
-#define __GET_METADATA__(v) \
-  struct vec_meta_t *metadata = ((struct vec_meta_t *)(v)) - 1;
+#define __svec_init_aligned_impl(type, align, size, ...)                  \
+		__svec_extension (svec(type))&((struct {                          \
+		  char pad[__svec_pad_size(align)];                               \
+		  struct vec_meta_t meta;                                         \
+	 	  __vec_align(align) type data[size];                             \
+	    }) {                                                              \
+	  	  __VEC_SVEC_MAGIC                                                \
+	  	  .meta.length = size,                                            \
+	  	  .meta.capacity = size,                                          \
+	  	  .meta.elemsize = sizeof(type),                                  \
+	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,               \
+	  	  .meta.alignment = align,                                        \
+	  	  .data = __VA_ARGS__                                             \
+	    }).data
 
-#define __SYNC_METADATA__(v) \
-  metadata = ((struct vec_meta_t *)(v)) - 1;
+#define __svec_init_w_cap_aligned_impl(type, cap, align)                  \
+		__svec_extension (svec(type))&((struct {                          \
+		  char pad[__svec_pad_size(align)];                               \
+		  struct vec_meta_t meta;                                         \
+	 	  __vec_align(align) type data[cap];                              \
+	    }) {                                                              \
+	  	  __VEC_SVEC_MAGIC                                                \
+	  	  .meta.length = 0,                                               \
+	  	  .meta.capacity = cap,                                           \
+	  	  .meta.elemsize = sizeof(type),                                  \
+	  	  .meta.allocationType = VEC_ALLOCATION_TYPE_STACK,               \
+	  	  .meta.alignment = align,                                        \
+	    }).data
+
+/*!
+ * \param v The vector that we want an iterator for
+ *
+ * \returns A pointer to the first element in a vector
+ */
+VEC_API void *
+vec_iter_begin(
+  vec_t v);
+
+/*!
+ * \param v The vector that we want an iterator for
+ *
+ * \returns A pointer to the memory block right after the last element in the vector
+ */
+VEC_API void *
+vec_iter_end(
+  vec_t v);
+
+/*!
+ * \brief A function that increments an iterator to make it point to the next
+ * element in the vector
+ *
+ * \param v The vector that is being iterated over
+ * \param iter Reference to the iterator that is being incremented
+ */
+VEC_API void
+vec_iter_next(
+  vec_t v, 
+  void **iter);
+
+#define vec_foreach(ref, vec) \
+  for(ref = vec_iter_begin(vec); (void*)ref < vec_iter_end(vec); vec_iter_next(vec, (void**)&ref))
+
+/*!
+ * \brief Typed counterpart of `vec_foreach()` that declares `ref` as a `T *`,
+ * reads the bounds once and steps by `sizeof(T)`. No function is called per
+ * element, so the loop can be unrolled and vectorized. `v` is evaluated twice
+ * and must not be resized inside the loop.
+ * \details Sample usage:
+ * ```
+ * vec_foreach_t(float, f, v) {
+ *   *f *= 2.0f;
+ * }
+ * ```
+ */
+#define vec_foreach_t(T, ref, v) \
+  for(T *ref = (T *)(v), *__vec_cat(__vec_end_, ref) = ref + __vec_hdr(v)->length; \
+      ref < __vec_cat(__vec_end_, ref); ++ref)
+
+/*!
+ * \brief Loops `i` over every index of the vector `v`, reading the length once.
+ * \details Sample usage:
+ * ```
+ * vec_foreach_idx(i, v) {
+ *   v[i] = (float)i;
+ * }
+ * ```
+ */
+#define vec_foreach_idx(i, v) \
+  for(size_t i = 0, __vec_cat(__vec_len_, i) = __vec_hdr(v)->length; \
+      i < __vec_cat(__vec_len_, i); ++i)
+
+/*!
+ * \brief Loops `i` over every index of several vectors at once (up to 16),
+ * with a single bounds check per iteration. The lengths are read once; if
+ * they differ, only the indices valid in every vector are visited.
+ * \details Sample usage:
+ * ```
+ * vec_foreach_zip(i, pos, vel, mass) {
+ *   pos[i].x += vel[i].x * dt / mass[i];
+ * }
+ * ```
+ */
+#define vec_foreach_zip(i, ...) \
+  for(size_t i = 0, __vec_cat(__vec_len_, i) = \
+        vec_zip_len(__VEC_SOA_NARG(__VA_ARGS__), (const vec_t []){ __VA_ARGS__ }); \
+      i < __vec_cat(__vec_len_, i); ++i)
+
+/*!
+ * \param n Number of vectors in `vs`
+ * \param vs The vector objects
+ *
+ * \returns The length of the shortest vector, 0 if `n` is 0
+ */
+VEC_API size_t
+vec_zip_len(
+  size_t n,
+  const vec_t *vs);
+
+/*!
+ * \brief A function that destroys a vector object. If a destructor function was
+ * passed while initializing the vector, then this function is called on every
+ * element before all reserved memory is freed.
+ *
+ * *Note*: For stack-allocated vectors (`svec`), destructors are called for 
+ * elements but no memory is freed.
+ *
+ * \param v The vector that is being destroyed
+ */
+VEC_API void
+vec_fini(
+  vec_t v);
+
+/*!
+ * \brief A function that copies a value to the end of a vector. If a copy
+ * function was passed while initializing the vector, then this function is
+ * called to copy the new element into the vector. Otherwise, memcpy is used
+ * with a length of `vec_meta.elemsize`. If a resize is needed but fails due to
+ * 'OOM' issues, then the vector is left unchanged and VEC_ERR_OOM is returned.
+ *
+ * For `svec`, as long as the capacity is more than the current size, a push
+ * operation is permitted. Otherwise, the operation is treated as an OOM.
+ *
+ * \param v Reference to the vector object
+ * \param val A pointer to the element that is to be copied to the end of the
+ * vector
+ *
+ * \returns The index of the element that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_push(
+  vec_t *v, 
+  void *val);
+
+/*!
+ * \brief A function that appends the elements of an array to the end of a
+ * vector.  If a resize is needed but fails due to 'OOM' issues, then the
+ * vector is left unchanged and a VEC_ERR_OOM is returned.
+ *
+ * For `svec`, as long as the capacity is more than the current size by the
+ * desired amount, an append operation is permitted. Otherwise, the operation 
+ * is treated as an OOM.
+ *
+ * *NOTE* The vector's copy function is not used; this is merely a memcpy
+ * operation. If a deep copy is needed, `vec_append_copy()` is the way to go.
+ *
+ * \param v Reference to the vector object
+ * \param arr A pointer to the array that is to be copied to the end of the
+ * vector
+ * \param size Number of elements in the array
+ *
+ * \returns The index of the first element that was appended to the vector. If 
+ * the operation failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_append(
+  vec_t *v,
+  const void *arr,
+  size_t size);
+
+/*!
+ * \brief Same as `vec_append()`, but the elements are deep copied. If a range
+ * copy function was set through `vec_set_copy_n()`, then it is called once for
+ * the whole array. Otherwise, the vector's copy function is called on every
+ * element, and memcpy is used if neither is set. The capacity is reserved
+ * once before any element is copied.
+ *
+ * \param v Reference to the vector object
+ * \param arr A pointer to the array that is to be copied to the end of the
+ * vector
+ * \param size Number of elements in the array
+ *
+ * \returns The index of the first element that was appended to the vector. If 
+ * the operation failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_append_copy(
+  vec_t *v,
+  const void *arr,
+  size_t size);
+
+/*!
+ * \brief Appends `src[indices[0]]`, `src[indices[1]]`, ... to the end of
+ * `dst`. The element that is `VEC_PREFETCH_DISTANCE` indices ahead is
+ * prefetched before each copy, which hides most of the cache misses of random
+ * indices. Elements are copied bit by bit, like `vec_append()`.
+ *
+ * *Note*: `dst` and `src` must have the same element size and must not be the
+ * same vector.
+ *
+ * \param dst Reference to the vector object that receives the elements
+ * \param src The vector object to read the elements from
+ * \param indices A `vec(size_t)` of indices into `src`
+ *
+ * \returns The index of the first element that was appended to `dst`. If the
+ * operation failed, a non-zero (vec_error_t) value is returned:
+ * `VEC_ERR_OUT_OF_BOUNDS` if an index is not less than `vec_len(src)`, in which
+ * case `dst` is left unchanged.
+ */
+VEC_API int
+vec_gather(
+  vec_t *dst,
+  vec_t src,
+  vec_t indices);
+
+/*!
+ * \brief Overwrites `dst[indices[0]]`, `dst[indices[1]]`, ... with the
+ * elements of `src`, in order, prefetching the slot that is
+ * `VEC_PREFETCH_DISTANCE` indices ahead for writing. Elements are copied bit
+ * by bit and the overwritten ones are not destroyed.
+ *
+ * *Note*: `dst` and `src` must have the same element size and must not be the
+ * same vector. If an index is repeated, the last element written to it wins.
+ *
+ * \param dst Reference to the vector object to write to
+ * \param src The vector object to read the elements from, with as many
+ * elements as `indices`
+ * \param indices A `vec(size_t)` of indices into `dst`
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the lengths
+ * of `src` and `indices` differ or an index is not less than `vec_len(dst)`,
+ * `VEC_ERR_OOM` if the buffer of `dst` is shared and could not be copied. In
+ * both cases, `dst` is left unchanged
+ */
+VEC_API vec_error_t
+vec_scatter(
+  vec_t *dst,
+  vec_t src,
+  vec_t indices);
+
+/*!
+ * \brief Sets the function that is used to copy ranges of elements into the
+ * vector (see `vec_append_copy()`).
+ *
+ * \param v Reference to the vector object
+ * \param copy_n The range copy function. Can be NULL
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_set_copy_n(
+  vec_t *v,
+  elem_copy_n copy_n);
+
+/*!
+ * \brief Adds an uninitialized element to the end of the vector, growing it
+ * if needed, so that the caller can construct the element in place.
+ *
+ * \param v Reference to the vector object
+ *
+ * \returns A pointer to the new element. NULL if the vector could not grow.
+ * The pointer is invalidated by the next operation that can reallocate.
+ */
+VEC_API void *
+vec_emplace_back(
+  vec_t *v);
+
+/*!
+ * \brief Adds `n` uninitialized elements to the end of the vector with a
+ * single capacity reservation, so that the caller can construct them in place.
+ *
+ * \param v Reference to the vector object
+ * \param n Number of elements to add
+ *
+ * \returns A pointer to the first new element. NULL if the vector could not
+ * grow. The pointer is invalidated by the next operation that can reallocate.
+ */
+VEC_API void *
+vec_emplace_n(
+  vec_t *v,
+  size_t n);
+
+/*!
+ * \brief Sets the function that is used to relocate elements of the vector.
+ * When set, reallocations move elements one by one through it instead of
+ * letting the allocator copy the block.
+ *
+ * \param v Reference to the vector object
+ * \param move The relocation function. Can be NULL
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_set_move(
+  vec_t *v,
+  elem_move move);
+
+/*!
+ * \brief Same as `vec_push()`, but ownership of the value is transferred to
+ * the vector instead of copying it. The value is relocated using the vector's
+ * move function, or memcpy if none was set, and must not be destroyed by the
+ * caller afterwards.
+ *
+ * \param v Reference to the vector object
+ * \param val A pointer to the element that is to be moved to the end of the
+ * vector
+ *
+ * \returns The index of the element that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned and `val` is untouched.
+ */
+VEC_API int
+vec_push_move(
+  vec_t *v,
+  void *val);
+
+/*!
+ * \brief Removes the value at the end of a vector and transfers its ownership
+ * to `out`, relocating it the same way as `vec_push_move()`. No copy or
+ * destructor function is called.
+ *
+ * \param v Reference to the vector object
+ * \param out A pointer to the memory block to which the popped element will be
+ * relocated
+ *
+ * \returns An error code. If the operation was successful, then `VEC_ERR_NONE`
+ * is returned.
+ */
+VEC_API vec_error_t
+vec_pop_move(
+  vec_t *v,
+  void *out);
+
+/*!
+ * \brief A function that copies the value at the end of a vector and removes
+ * it from the vector. If a copy function was passed while initializing the 
+ * vector, then this function is used. Otherwise, memcpy is used with a length 
+ * of `vec_meta.elemsize`
+ *
+ * \param v Reference to the vector object
+ * \param out A pointer to the memory block at which the popped element will be
+ * copied. If NULL is passed, then the element is destructed. Otherwise, the
+ * element is copied to `out` and the receiving code is responsible for its
+ * destruction.
+ * 
+ * \returns An error code. If the operation was successful, then `VEC_ERR_NONE` 
+ * is returned.
+ */
+VEC_API vec_error_t
+vec_pop(
+  vec_t *v, 
+  void *out);
+
+/*!
+ * \brief Removes the element at `idx` in O(1) by moving the last element into
+ * its slot. The order of the elements is not preserved. If a destructor
+ * function was passed while initializing the vector, then it is called on the
+ * removed element.
+ *
+ * \param v Reference to the vector object
+ * \param idx Index of the element that should be removed
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if `idx` is not
+ * less than the length of the vector
+ */
+VEC_API vec_error_t
+vec_swap_remove(
+  vec_t *v,
+  size_t idx);
+
+/*!
+ * \brief Removes `count` elements starting at `first`, shifting the elements
+ * that follow them with a single memmove. If a destructor function was passed
+ * while initializing the vector, then it is called on every removed element.
+ *
+ * \param v Reference to the vector object
+ * \param first Index of the first element that should be removed
+ * \param count Number of elements that should be removed
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the range
+ * does not lie within the vector
+ */
+VEC_API vec_error_t
+vec_erase_range(
+  vec_t *v,
+  size_t first,
+  size_t count);
+
+/*!
+ * \brief Copies a value into the vector at `idx`, shifting the elements from
+ * `idx` onwards by one. The value is copied the same way as in `vec_push()`.
+ *
+ * \param v Reference to the vector object
+ * \param idx Index at which the value should be inserted. Can be equal to the
+ * length of the vector.
+ * \param val A pointer to the element that is to be copied into the vector.
+ * Must not point into the vector itself.
+ *
+ * \returns The index of the inserted element. If the operation failed, a
+ * non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_insert(
+  vec_t *v,
+  size_t idx,
+  const void *val);
+
+/*!
+ * \brief Copies the elements of an array into the vector at `idx`, shifting
+ * the elements from `idx` onwards by `count`. The capacity is reserved once,
+ * and the elements are copied the same way as in `vec_append_copy()`.
+ *
+ * \param v Reference to the vector object
+ * \param idx Index at which the array should be inserted. Can be equal to the
+ * length of the vector.
+ * \param arr A pointer to the array that is to be copied into the vector.
+ * Must not point into the vector itself.
+ * \param count Number of elements in the array
+ *
+ * \returns The index of the first inserted element. If the operation failed,
+ * a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_insert_range(
+  vec_t *v,
+  size_t idx,
+  const void *arr,
+  size_t count);
+
+/*!
+ * \brief A function that returns the last element in the vector.
+ *
+ * \param v Reference to the vector object
+ * 
+ * \returns Pointer to the last element in the vector. NULL if the vector is
+ * empty.
+ */
+VEC_API void *
+vec_last(
+    vec_t v);
+
+/*!
+ * \brief A function that returns the length of a vector
+ *
+ * \param v The vector object
+ *
+ * \returns Current length of the vector
+ */
+VEC_API size_t
+vec_len(
+  vec_t v);
+
+/*!
+ * \brief A function that returns the capacity of a vector
+ *
+ * \param v The vector object
+ *
+ * \returns Current capacity of the vector
+ */
+VEC_API size_t
+vec_capacity(
+  vec_t v);
+
+/*!
+ * \brief Calls the free operation (if exists) on every element, then sets
+ * the length to 0.
+ *
+ * \param v The vector object
+ *
+ * \returns 0 on success, `VEC_ERR_SHARED` if other handles still share the
+ * buffer (see `vec_share()`), in which case nothing is done. Use
+ * `vec_clear_unshare()` to empty a vector that may be shared.
+ */
+VEC_API int
+vec_clear(
+  vec_t v);
+
+/*!
+ * \brief Like `vec_clear()`, but also empties a vector whose buffer is shared.
+ * \details If other handles still share the buffer (see `vec_share()`), the
+ * elements are left to them: this handle drops its reference and gets a new,
+ * empty buffer instead. Otherwise it behaves exactly like `vec_clear()`.
+ *
+ * \param v Reference to the vector object
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the buffer was shared
+ * and a new one could not be allocated, in which case nothing is done
+ */
+VEC_API vec_error_t
+vec_clear_unshare(
+  vec_t *v);
+
+/*!
+ * \brief Sets the length of the vector to `len`.
+ *
+ * \details If `len` is less than `v`'s current length, then `v`'s length is
+ * amended. Otherwise, the capacity is checked to make sure that there is enough
+ * space for the new len.
+ *
+ * For `svec`, if the `len` is more than the already allocated capacity, it is
+ * treated as an OOM.
+ *
+ * \param v Reference to the vector object
+ * \param len The desired new length
+ *
+ * \returns `VEC_ERR_NONE` on success
+ */
+VEC_API vec_error_t
+vec_setlen(
+  vec_t *v, 
+  size_t len);
+
+/*!
+ * \brief Sets the capacity of the vector to `cap`. If `cap` is less than
+ * the length, the vector is truncated to `cap` elements; like with
+ * `vec_setlen()`, the dropped elements are not destroyed.
+ *
+ * \param v Reference to the vector object
+ * \param cap The desired new capacity
+ *
+ * For stack-allocated vectors, `VEC_ERR_OOM` is returned. Vectors that live in
+ * caller-provided storage or in a mapped file keep their storage when `cap` is
+ * smaller than their capacity: only the length is truncated.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_setcapacity(
+  vec_t *v, 
+  size_t cap);
+
+/*!
+ * \brief Makes sure that the vector can hold at least `n` elements without
+ * any further reallocation. If the capacity is already large enough, nothing
+ * is done. Otherwise, the capacity is set to exactly `n` in a single
+ * reallocation.
+ *
+ * For `svec`, if `n` is more than the already allocated capacity, it is
+ * treated as an OOM.
+ *
+ * \param v Reference to the vector object
+ * \param n The number of elements that should fit in the vector
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_reserve(
+  vec_t *v,
+  size_t n);
+
+/*!
+ * \brief Reduces the capacity of the vector to its length, giving the unused
+ * memory back to the allocator.
+ *
+ * For stack-allocated vectors, nothing is done.
+ *
+ * \param v Reference to the vector object
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_shrink_to_fit(
+  vec_t *v);
+
+/*!
+ * \brief Sets the policy that decides whether `vec_pop()` and `vec_setlen()`
+ * reduce the capacity of the vector. Stack-allocated vectors are never shrunk.
+ *
+ * \param v Reference to the vector object
+ * \param policy The shrink policy
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_set_shrink_policy(
+  vec_t *v,
+  vec_shrink_policy_t policy);
+
+/*!
+ * \brief Grows the vector's capacity by a factor of `VEC_GROWTH_RATE`
+ *
+ * \param Reference to the vector object
+ *
+ * \returns `VEC_ERR_NONE` on success
+ */
+VEC_API vec_error_t
+vec_grow(
+  vec_t *v);
+
+/*!
+ * \brief Returns a second handle to the vector that aliases the same buffer,
+ * without copying anything.
+ * \details The buffer is reference counted and copied on write: the first
+ * call that modifies it through one of the handles (`vec_push()`,
+ * `vec_setlen()`, `vec_pop()`, ...) first gives that handle its own copy, made
+ * with the vector's copy functions. Every handle is released with
+ * `vec_fini()`; the last one destroys the buffer. Handles may be used and
+ * released on different threads, as long as each handle is only used by one
+ * thread at a time.
+ *
+ * Writes through the element pointer (including those made by the callbacks
+ * of `vec_parallel_for()`) do not copy the buffer and are seen by every
+ * handle; call `vec_unshare()` before them.
+ * Only heap-allocated vectors can share their buffer; for other vectors the
+ * new handle is a copy made with `vec_clone()`.
+ *
+ * Sample usage:
+ * ```
+ * vec(entry_t) snapshot = vec_share(table); // O(1)
+ * // Hand `snapshot` to a worker, which calls vec_fini(snapshot) when done.
+ * vec_push(&table, &e);                     // `table` gets its own copy first
+ * ```
+ *
+ * \param v The vector object
+ *
+ * \returns A new handle to the vector. NULL if a copy was needed and failed.
+ */
+VEC_API vec_t
+vec_share(
+  vec_t v);
+
+/*!
+ * \brief Makes sure that no other handle shares the buffer of the vector,
+ * copying it if needed (see `vec_share()`).
+ *
+ * \param v Reference to the vector object
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the copy could not be
+ * allocated, in which case the vector is left unchanged
+ */
+VEC_API vec_error_t
+vec_unshare(
+  vec_t *v);
+
+/*!
+ * \brief Creates a heap-allocated copy of the vector with the same element
+ * functions, allocator, alignment and shrink policy. The elements are copied
+ * the same way as in `vec_append_copy()`.
+ *
+ * \param v The vector object
+ *
+ * \returns The copy, whose capacity is the length of `v`. NULL on OOM.
+ */
+VEC_API vec_t
+vec_clone(
+  vec_t v);
+
+#ifdef VEC_STATS
+#include <stdio.h>
+
+/*!
+ * \param v The vector object. If NULL, the counters of all vectors combined
+ * are returned.
+ *
+ * \returns A snapshot of the counters
+ */
+VEC_API vec_stats_t
+vec_stats_get(
+  vec_t v);
+
+/*!
+ * \brief Sets all counters to 0.
+ *
+ * \param v The vector object. If NULL, the global counters are reset.
+ */
+VEC_API void
+vec_stats_reset(
+  vec_t v);
+
+/*!
+ * \brief Writes the counters in a human readable form to `out`.
+ *
+ * \param v The vector object. If NULL, the global counters are written.
+ * \param out The stream to write to
+ */
+VEC_API void
+vec_stats_dump(
+  vec_t v,
+  FILE *out);
+
+VEC_API void
+__vec_stats_push(
+  struct vec_meta_t *metadata,
+  size_t count);
+
+#define __VEC_STATS_PUSH(metadata, count) __vec_stats_push(metadata, count)
+#else
+#define __VEC_STATS_PUSH(metadata, count) ((void)0)
+#endif
+
+/*!
+ * \brief Signature of a function that processes a contiguous range of vector
+ * elements.
+ * \param first Pointer to the first element of the range
+ * \param begin Index of the first element of the range
+ * \param count Number of elements in the range
+ * \param ctx User data that was passed to `vec_parallel_for()`
+ */
+typedef void (*vec_range_fn)(void *first, size_t begin, size_t count, void *ctx);
+
+/*!
+ * \brief Interface to an external job system.
+ * \details `run_fn` must call `job(data, i)` exactly once for every `i` in
+ * `[0, count)`, in any order and on any thread, and return once all calls
+ * have returned.
+ */
+typedef struct vec_job_system_t {
+  //! Runs `count` jobs and waits for them.
+  void (*run_fn)(void *ctx, size_t count, void (*job)(void *data, size_t idx), void *data);
+  //! User data that is passed to `run_fn`.
+  void *ctx;
+} vec_job_system_t;
+
+/*!
+ * \brief Sets the job system that `vec_parallel_for()` dispatches to.
+ *
+ * *Note*: This is a process-wide setting and is not synchronized; it is meant
+ * to be set once at startup.
+ *
+ * \param jobs The job system. If NULL, the built-in pool is restored.
+ */
+VEC_API void
+vec_set_job_system(
+  const vec_job_system_t *jobs);
+
+/*!
+ * \brief Splits the vector into chunks and calls `fn` on every chunk in
+ * parallel. Chunks hold a multiple of `grain` elements and, whenever the
+ * element size allows it, start on a `VEC_CACHE_LINE` boundary so that no two
+ * chunks share a cache line. Returns once every chunk was processed.
+ *
+ * The vector must not be resized while the call is running.
+ *
+ * \param v The vector object
+ * \param fn The function that is called on every chunk
+ * \param ctx User data that is passed to `fn`
+ * \param grain Minimum number of elements per chunk. If 0, a single cache
+ * line worth of elements is used.
+ */
+VEC_API void
+vec_parallel_for(
+  vec_t v,
+  vec_range_fn fn,
+  void *ctx,
+  size_t grain);
+
+/*!
+ * \brief Stops and joins the worker threads of the built-in pool. They are
+ * started again by the next call to `vec_parallel_for()`.
+ */
+VEC_API void
+vec_parallel_shutdown(void);
+
+/*!
+ * \brief Vector that multiple threads can push into without locking.
+ * \details Elements live in segments of geometrically increasing size that
+ * are allocated on demand and never moved, so pointers to elements stay valid
+ * while other threads keep pushing. Each push marks its slot as ready once
+ * its copy is complete, without waiting for the others; `vec_concurrent_len()`
+ * covers the leading slots that are ready.
+ * `vec_concurrent_freeze()` turns the contents into a regular `vec_t`.
+ *
+ * Sample usage:
+ * ```
+ * vec_concurrent_t events;
+ * vec_concurrent_init(&events, sizeof(event_t), NULL, NULL);
+ * // On any number of threads:
+ * vec_concurrent_push(&events, &ev);
+ * // After joining the producers:
+ * vec(event_t) all = vec_concurrent_freeze(&events);
+ * ```
+ */
+typedef struct vec_concurrent_t {
+  //! Number of slots that were claimed by pushes. Updated atomically.
+  __vec_align(VEC_CACHE_LINE) size_t length;
+  //! Number of leading slots known to be ready. Advanced atomically by
+  //! `vec_concurrent_len()` over the ready flags of the slots.
+  __vec_align(VEC_CACHE_LINE) size_t committed;
+  //! Segment `k` holds `1 << (VEC_SEG_BASE_LOG2 + k)` elements, followed by one
+  //! ready flag per element. Published atomically.
+  __vec_align(VEC_CACHE_LINE) void *segments[VEC_SEG_MAX];
+  //! The size (in bytes) of memory that each element takes.
+  size_t elemsize;
+  //! If set, the vector uses this function to copy new values into the vector.
+  elem_copy copy_fn;
+  //! If set, the vector uses this function to destroy stored values.
+  elem_destr destr_fn;
+  //! The allocator that owns the segments.
+  const vec_allocator_t *allocator;
+} vec_concurrent_t;
+
+/*!
+ * \brief Initializes a concurrent vector. Memory comes from the default
+ * allocator, which must be thread-safe.
+ *
+ * \param c The concurrent vector object to initialize
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param copy A function pointer to the function that should be used to copy an element
+ * into the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ */
+VEC_API void
+vec_concurrent_init(
+  vec_concurrent_t *c,
+  size_t elemsize,
+  elem_copy copy,
+  elem_destr destr);
+
+/*!
+ * \brief Destroys every element and releases all segments. No thread may push
+ * while the vector is being destroyed.
+ *
+ * \param c The concurrent vector object
+ */
+VEC_API void
+vec_concurrent_fini(
+  vec_concurrent_t *c);
+
+/*!
+ * \brief Copies a value to the end of the vector. Safe to call from any
+ * number of threads at once. A slot is only claimed once the segment holding
+ * it exists, so a failed allocation never leaves a hole in the vector. The
+ * call never waits for other pushes: the element is counted by
+ * `vec_concurrent_len()` once every element before it is complete too.
+ *
+ * \param c The concurrent vector object
+ * \param val A pointer to the element that is to be copied to the end of the
+ * vector
+ *
+ * \returns The index of the element that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned: `VEC_ERR_OOM` on
+ * allocation failure, `VEC_ERR_OUT_OF_BOUNDS` if the vector is being frozen.
+ */
+VEC_API int
+vec_concurrent_push(
+  vec_concurrent_t *c,
+  const void *val);
+
+/*!
+ * \param c The concurrent vector object
+ * \param idx Index of an element, less than `vec_concurrent_len()`
+ *
+ * \returns A pointer to the element at `idx`. The pointer stays valid until the
+ * vector is frozen or destroyed.
+ */
+VEC_API void *
+vec_concurrent_at(
+  vec_concurrent_t *c,
+  size_t idx);
+
+/*!
+ * \param c The concurrent vector object
+ *
+ * \returns The number of leading elements whose push has completed. Every
+ * element below that index can be read with `vec_concurrent_at()`. Safe to call
+ * while other threads push, but not during `vec_concurrent_freeze()` or
+ * `vec_concurrent_fini()`.
+ */
+VEC_API size_t
+vec_concurrent_len(
+  vec_concurrent_t *c);
+
+/*!
+ * \brief Moves the contents of the concurrent vector into a regular vector
+ * with a single allocation, then leaves `c` empty and ready for reuse. Pushes
+ * that already claimed a slot are waited for; pushes that start while the
+ * vector is being frozen fail with `VEC_ERR_OUT_OF_BOUNDS` and may be retried
+ * once this call has returned.
+ *
+ * \param c The concurrent vector object
+ *
+ * \returns A vector holding every pushed element in index order. NULL on OOM,
+ * in which case `c` is left unchanged, or if another thread is freezing `c`.
+ */
+VEC_API vec_t
+vec_concurrent_freeze(
+  vec_concurrent_t *c);
+
+/*!
+ * \brief Vector whose elements never move once they are pushed.
+ * \details Elements live in segments of geometrically increasing size (see
+ * `VEC_SEG_BASE_LOG2`). Growing allocates a new segment instead of
+ * reallocating, so no element is ever copied and pointers to elements stay
+ * valid until the element is popped. Indexing is O(1).
+ *
+ * Sample usage:
+ * ```
+ * vec_seg_t s;
+ * vec_seg_init(&s, sizeof(int), NULL, NULL);
+ * vec_seg_push(&s, &val);
+ * int *ref;
+ * vec_seg_foreach(ref, &s) {
+ *   ...
+ * }
+ * vec_seg_fini(&s);
+ * ```
+ */
+typedef struct vec_seg_t {
+  //! The number of elements in the vector.
+  size_t length;
+  //! The number of segments that are currently allocated.
+  size_t nsegments;
+  //! Segment `k` holds `1 << (VEC_SEG_BASE_LOG2 + k)` elements.
+  void *segments[VEC_SEG_MAX];
+  //! The size (in bytes) of memory that each element takes.
+  size_t elemsize;
+  //! If set, the vector uses this function to copy new values into the vector.
+  elem_copy copy_fn;
+  //! If set, the vector uses this function to destroy stored values.
+  elem_destr destr_fn;
+  //! The allocator that owns the segments.
+  const vec_allocator_t *allocator;
+} vec_seg_t;
+
+/*!
+ * \brief Initializes a segmented vector.
+ *
+ * \param s The segmented vector object to initialize
+ * \param elemsize Memory (in bytes) that should be reserved per element in the vector
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the vector. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * vector element. Can be NULL
+ */
+VEC_API void
+vec_seg_init(
+  vec_seg_t *s,
+  size_t elemsize,
+  elem_copy copy,
+  elem_destr destr);
+
+/*!
+ * \brief Destroys every element and releases all segments.
+ *
+ * \param s The segmented vector object
+ */
+VEC_API void
+vec_seg_fini(
+  vec_seg_t *s);
+
+/*!
+ * \brief Same as `vec_push()` for segmented vectors. No existing element is
+ * moved when the vector grows.
+ *
+ * \param s The segmented vector object
+ * \param val A pointer to the element that is to be copied to the end of the
+ * vector
+ *
+ * \returns The index of the element that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_seg_push(
+  vec_seg_t *s,
+  const void *val);
+
+/*!
+ * \brief Same as `vec_pop()` for segmented vectors. Segments are kept for
+ * later pushes until `vec_seg_fini()`.
+ *
+ * \param s The segmented vector object
+ * \param out A pointer to the memory block at which the popped element will be
+ * copied. If NULL is passed, then the element is destructed.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the vector
+ * is empty
+ */
+VEC_API vec_error_t
+vec_seg_pop(
+  vec_seg_t *s,
+  void *out);
+
+/*!
+ * \param s The segmented vector object
+ * \param idx Index of the element
+ *
+ * \returns A pointer to the element at `idx`, or NULL if `idx` is out of bounds
+ */
+VEC_API void *
+vec_seg_at(
+  vec_seg_t *s,
+  size_t idx);
+
+/*!
+ * \param s The segmented vector object
+ *
+ * \returns Current length of the vector
+ */
+VEC_API size_t
+vec_seg_len(
+  vec_seg_t *s);
+
+//! Cursor over the elements of a `vec_seg_t`. See `vec_seg_foreach()`.
+typedef struct vec_seg_iter_t {
+  vec_seg_t *s;
+  //! Segment that `elem` points into.
+  size_t k;
+  //! Number of elements left, including `elem`.
+  size_t remaining;
+  //! Current element. NULL once the iteration is over.
+  char *elem;
+  //! End of the current segment.
+  char *seg_end;
+} vec_seg_iter_t;
+
+static inline vec_seg_iter_t
+vec_seg_iter_begin(
+    vec_seg_t *s)
+{
+  vec_seg_iter_t it = { s, 0, s->length, NULL, NULL };
+  if(s->length) {
+    it.elem    = (char *)s->segments[0];
+    it.seg_end = it.elem + ((size_t)1 << VEC_SEG_BASE_LOG2) * s->elemsize;
+  }
+  return it;
+}
+
+static inline void
+vec_seg_iter_next(
+    vec_seg_iter_t *it)
+{
+  if(--it->remaining == 0) {
+    it->elem = NULL;
+    return;
+  }
+  it->elem += it->s->elemsize;
+  if(it->elem == it->seg_end) {
+    it->k++;
+    it->elem    = (char *)it->s->segments[it->k];
+    it->seg_end = it->elem + ((size_t)1 << (VEC_SEG_BASE_LOG2 + it->k)) * it->s->elemsize;
+  }
+}
+
+/*!
+ * \brief Segmented counterpart of `vec_foreach()`. Walks every segment with a
+ * pointer increment and only switches segments at their boundaries.
+ */
+#define vec_seg_foreach(ref, s)                                                \
+  for(vec_seg_iter_t __vec_cat(__vec_it_, ref) = vec_seg_iter_begin(s);       \
+      ((ref) = (void *)__vec_cat(__vec_it_, ref).elem) != NULL;               \
+      vec_seg_iter_next(&__vec_cat(__vec_it_, ref)))
+
+//! Pointer to the metadata of the vector `v`.
+#define __vec_hdr(v) (((struct vec_meta_t *)(v)) - 1)
+
+// Nonzero if popping from the vector with the metadata `m` needs `vec_pop()`:
+// for its shrink policy or, with `VEC_API_CHECK`, to poison the slot.
+#ifdef VEC_API_CHECK
+#define __vec_typed_pop_slow(m) 1
+#else
+#define __vec_typed_pop_slow(m) ((m)->shrink_policy != VEC_SHRINK_NONE)
+#endif
+
+/*!
+ * \brief Declares `static inline` functions that are specialized for vectors
+ * of type `T`.
+ * \details The generated functions use `sizeof(T)` and plain assignments
+ * instead of the vector's `elemsize` and copy/destroy functions, so they
+ * should only be used on vectors of trivially copyable elements. They share
+ * the layout of `struct vec_meta_t` and can be freely mixed with the generic
+ * API.
+ *
+ * Sample usage:
+ * ```
+ * VEC_DECLARE_TYPED(float, vecf)
+ *
+ * vec(float) v = vec_init(float);
+ * vecf_reserve(&v, 1024);
+ * vecf_push(&v, 1.0f);       // Same semantics as `vec_push()`
+ * *vecf_at(v, 0) = 2.0f;     // Pointer to the element at index 0
+ * float f; vecf_pop(&v, &f); // Same semantics as `vec_pop()`
+ * ```
+ */
+#define VEC_DECLARE_TYPED(T, name)                                        \
+  static inline int                                                       \
+  name##_push(                                                            \
+      vec(T) *v,                                                          \
+      T val)                                                              \
+  {                                                                       \
+    struct vec_meta_t *metadata = __vec_hdr(*v);                          \
+    if (__vec_is_shared(metadata)) {                                      \
+      vec_error_t share_err = vec_unshare((vec_t *)v);                    \
+      if (share_err) {                                                    \
+        return share_err;                                                 \
+      }                                                                   \
+      metadata = __vec_hdr(*v);                                           \
+    }                                                                     \
+    if (metadata->length == metadata->capacity) {                         \
+      vec_error_t grow_err = vec_grow((vec_t *)v);                        \
+      if (grow_err) {                                                     \
+        return grow_err;                                                  \
+      }                                                                   \
+      metadata = __vec_hdr(*v);                                           \
+    }                                                                     \
+    (*v)[metadata->length] = val;                                         \
+    __VEC_STATS_PUSH(metadata, 1);                                        \
+    return (int)metadata->length++;                                       \
+  }                                                                       \
+                                                                          \
+  static inline vec_error_t                                               \
+  name##_pop(                                                             \
+      vec(T) *v,                                                          \
+      T *out)                                                             \
+  {                                                                       \
+    struct vec_meta_t *metadata = __vec_hdr(*v);                          \
+    if (__vec_typed_pop_slow(metadata)) {                                 \
+      return vec_pop((vec_t *)v, out);                                    \
+    }                                                                     \
+    if (__vec_is_shared(metadata)) {                                      \
+      vec_error_t share_err = vec_unshare((vec_t *)v);                    \
+      if (share_err) {                                                    \
+        return share_err;                                                 \
+      }                                                                   \
+      metadata = __vec_hdr(*v);                                           \
+    }                                                                     \
+    if (!metadata->length) {                                              \
+      return VEC_ERR_OUT_OF_BOUNDS;                                       \
+    }                                                                     \
+    metadata->length--;                                                   \
+    if (out) {                                                            \
+      *out = (*v)[metadata->length];                                      \
+    }                                                                     \
+    return VEC_ERR_NONE;                                                  \
+  }                                                                       \
+                                                                          \
+  static inline T *                                                       \
+  name##_at(                                                              \
+      vec(T) v,                                                           \
+      size_t idx)                                                         \
+  {                                                                       \
+    return v + idx;                                                       \
+  }                                                                       \
+                                                                          \
+  static inline vec_error_t                                               \
+  name##_reserve(                                                         \
+      vec(T) *v,                                                          \
+      size_t n)                                                           \
+  {                                                                       \
+    if (n <= __vec_hdr(*v)->capacity) {                                   \
+      return VEC_ERR_NONE;                                                \
+    }                                                                     \
+    return vec_reserve((vec_t *)v, n);                                    \
+  }
+
+/*!
+ * \brief Typed scanning kernels over the elements of a `vec(T)`.
+ * \details For every `T` in `int32_t` (`i32`), `uint32_t` (`u32`), `int64_t`
+ * (`i64`), `uint64_t` (`u64`), `float` (`f32`) and `double` (`f64`):
+ * ```
+ * ptrdiff_t vec_find_i32(const int32_t *v, int32_t val);              // Index of the first element equal to `val`, -1 if there is none
+ * size_t    vec_count_i32(const int32_t *v, int32_t val);             // Number of elements equal to `val`
+ * int64_t   vec_sum_i32(const int32_t *v);                            // Sum of all elements
+ * int       vec_minmax_i32(const int32_t *v, int32_t *min, int32_t *max); // Smallest and largest element
+ * int       vec_fill_i32(int32_t **v, int32_t val);                   // Sets every element to `val`
+ * ```
+ * Sums of 32-bit integers are accumulated in 64 bits. Float sums are computed
+ * in several lanes at once, so their rounding may differ from a sequential
+ * loop. `vec_minmax_T()` returns `VEC_ERR_OUT_OF_BOUNDS` for empty vectors;
+ * its result is unspecified if the vector contains NaNs. `vec_fill_T()` takes
+ * a reference since it may have to copy a shared buffer first (see
+ * `vec_share()`), and returns `VEC_ERR_OOM` if that fails.
+ *
+ * The kernels use SSE2, AVX2 or AVX-512 on x86, picked once at runtime from
+ * what the CPU supports, and NEON on ARM. Other targets (and builds with
+ * `VEC_NO_SIMD`) use scalar loops.
+ */
+#define __VEC_DECLARE_KERNELS(T, sfx, ACC)                                \
+  VEC_API ptrdiff_t                                                       \
+  vec_find_##sfx(                                                         \
+    const T *v,                                                           \
+    T val);                                                               \
+                                                                          \
+  VEC_API size_t                                                          \
+  vec_count_##sfx(                                                        \
+    const T *v,                                                           \
+    T val);                                                               \
+                                                                          \
+  VEC_API ACC                                                             \
+  vec_sum_##sfx(                                                          \
+    const T *v);                                                          \
+                                                                          \
+  VEC_API vec_error_t                                                     \
+  vec_minmax_##sfx(                                                       \
+    const T *v,                                                           \
+    T *min,                                                               \
+    T *max);                                                              \
+                                                                          \
+  VEC_API vec_error_t                                                     \
+  vec_fill_##sfx(                                                         \
+    T **v,                                                                \
+    T val);
+
+__VEC_DECLARE_KERNELS(int32_t, i32, int64_t)
+__VEC_DECLARE_KERNELS(uint32_t, u32, uint64_t)
+__VEC_DECLARE_KERNELS(int64_t, i64, int64_t)
+__VEC_DECLARE_KERNELS(uint64_t, u64, uint64_t)
+__VEC_DECLARE_KERNELS(float, f32, float)
+__VEC_DECLARE_KERNELS(double, f64, double)
+
+/*!
+ * \brief Signature of a function that compares two elements, with the same
+ * contract as the comparator of `qsort()`.
+ */
+typedef int (*vec_cmp_fn)(const void *a, const void *b);
+
+//! Types of the keys that `vec_sort_by_key()` can sort by.
+typedef enum vec_key_type_t {
+  VEC_KEY_I32,
+  VEC_KEY_U32,
+  VEC_KEY_I64,
+  VEC_KEY_U64,
+  VEC_KEY_F32,
+  VEC_KEY_F64,
+} vec_key_type_t;
+
+/*!
+ * \brief Sorts the vector in ascending order according to `cmp`. Elements are
+ * moved bit for bit, as with `qsort()`.
+ * \details Vectors of at least `VEC_SORT_PARALLEL_MIN` elements are split into
+ * chunks that are sorted and then merged in parallel through the job system
+ * (see `vec_parallel_for()`), if there is one.
+ *
+ * \param v Reference to the vector object
+ * \param cmp The comparison function
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the buffer was shared
+ * and could not be copied, in which case the vector is left untouched
+ */
+VEC_API vec_error_t
+vec_sort(
+  vec_t *v,
+  vec_cmp_fn cmp);
+
+/*!
+ * \brief Sorts a vector of structs by a numeric key inside every element, with
+ * a stable radix sort. Elements are moved bit for bit.
+ *
+ * \param v Reference to the vector object
+ * \param key_offset Offset (in bytes) of the key inside an element, e.g. from
+ * `offsetof()`
+ * \param key_type Type of the key
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the scratch memory
+ * could not be allocated or the buffer was shared and could not be copied,
+ * in which case the vector is left untouched
+ */
+VEC_API vec_error_t
+vec_sort_by_key(
+  vec_t *v,
+  size_t key_offset,
+  vec_key_type_t key_type);
+
+/*!
+ * \param v A vector that is sorted according to `cmp`
+ * \param key A pointer to a value of the vector's element type
+ * \param cmp The comparison function the vector was sorted with
+ *
+ * \returns The index of the first element that is not less than `key`, or
+ * the length of the vector if there is none
+ */
+VEC_API size_t
+vec_lower_bound(
+  vec_t v,
+  const void *key,
+  vec_cmp_fn cmp);
+
+/*!
+ * \param v A vector that is sorted according to `cmp`
+ * \param key A pointer to a value of the vector's element type
+ * \param cmp The comparison function the vector was sorted with
+ *
+ * \returns A pointer to the first element that compares equal to `key`, or
+ * NULL if there is none
+ */
+VEC_API void *
+vec_bsearch(
+  vec_t v,
+  const void *key,
+  vec_cmp_fn cmp);
+
+/*!
+ * \brief Typed sorts in ascending order, using an LSD radix sort on the bits
+ * of the keys instead of comparisons. Passes in which every key has the same
+ * digit are skipped.
+ * \details Available for `int32_t` (`vec_sort_i32()`), `uint32_t`, `int64_t`,
+ * `uint64_t`, `float` and `double`. Floats are ordered by value, with
+ * negative NaNs first and positive NaNs last. If the scratch buffer cannot be
+ * allocated, `qsort()` is used instead. Like `vec_sort()`, they take a
+ * reference and return `VEC_ERR_OOM` if a shared buffer could not be copied.
+ */
+#define __VEC_DECLARE_SORT(T, sfx)                                        \
+  VEC_API vec_error_t                                                     \
+  vec_sort_##sfx(                                                         \
+    T **v);
+
+__VEC_DECLARE_SORT(int32_t, i32)
+__VEC_DECLARE_SORT(uint32_t, u32)
+__VEC_DECLARE_SORT(int64_t, i64)
+__VEC_DECLARE_SORT(uint64_t, u64)
+__VEC_DECLARE_SORT(float, f32)
+__VEC_DECLARE_SORT(double, f64)
+
+/*!
+ * \brief Shared header of a structure-of-arrays vector. See `VEC_SOA_DECLARE()`.
+ */
+typedef struct vec_soa_t {
+  //! The number of rows in the vector.
+  size_t length;
+  //! The number of rows that every column has room for.
+  size_t capacity;
+  //! The number of columns.
+  size_t ncolumns;
+  //! Size (in bytes) of an element of each column.
+  const size_t *sizes;
+  //! Byte vector that holds all columns back to back, each one starting on a
+  //! `VEC_CACHE_LINE` boundary. Grown with `vec_setcapacity()`.
+  vec_t block;
+} vec_soa_t;
+
+/*!
+ * \brief Initializes an empty structure-of-arrays vector. Called by the
+ * `init` function that `VEC_SOA_DECLARE()` generates.
+ *
+ * \param s The header to initialize
+ * \param ncolumns Number of columns
+ * \param sizes Element size of every column. Must outlive the vector
+ * \param columns Column pointers, updated whenever the columns move
+ * \param allocator The allocator for the columns. If NULL, the default one is used
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_soa_init_impl(
+  vec_soa_t *s,
+  size_t ncolumns,
+  const size_t *sizes,
+  void **columns,
+  const vec_allocator_t *allocator);
+
+/*!
+ * \brief Releases the memory of all columns.
+ *
+ * \param s The header of the vector
+ * \param columns Column pointers of the vector
+ */
+VEC_API void
+vec_soa_fini_impl(
+  vec_soa_t *s,
+  void **columns);
+
+/*!
+ * \brief Same as `vec_setcapacity()` for every column at once. Rows past
+ * `cap` are dropped.
+ *
+ * \param s The header of the vector
+ * \param columns Column pointers of the vector
+ * \param cap The new capacity, in rows
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure, in
+ * which case the vector is left untouched
+ */
+VEC_API vec_error_t
+vec_soa_setcapacity_impl(
+  vec_soa_t *s,
+  void **columns,
+  size_t cap);
+
+/*!
+ * \brief Appends an uninitialized row, growing the columns with the same
+ * policy as `vec_push()` if needed.
+ *
+ * \param s The header of the vector
+ * \param columns Column pointers of the vector
+ *
+ * \returns The index of the new row. If the operation failed, a non-zero
+ * (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_soa_push_impl(
+  vec_soa_t *s,
+  void **columns);
+
+/*!
+ * \brief Same as `vec_swap_remove()`: the last row is copied over row `idx`
+ * in every column.
+ *
+ * \param s The header of the vector
+ * \param columns Column pointers of the vector
+ * \param idx Index of the row that should be removed
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if `idx` is not
+ * less than the length of the vector
+ */
+VEC_API vec_error_t
+vec_soa_swap_remove_impl(
+  vec_soa_t *s,
+  void **columns,
+  size_t idx);
+
+#define __VEC_SOA_NARG(...) __VEC_SOA_NARG_IMPL(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __VEC_SOA_NARG_IMPL(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+
+// Applies `M` to every `(type, name)` pair of the argument list.
+#define __VEC_SOA_MAP(M, ...) __vec_cat(__VEC_SOA_MAP_, __VEC_SOA_NARG(__VA_ARGS__))(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_1(M, p) M p
+#define __VEC_SOA_MAP_2(M, p, ...) M p __VEC_SOA_MAP_1(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_3(M, p, ...) M p __VEC_SOA_MAP_2(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_4(M, p, ...) M p __VEC_SOA_MAP_3(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_5(M, p, ...) M p __VEC_SOA_MAP_4(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_6(M, p, ...) M p __VEC_SOA_MAP_5(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_7(M, p, ...) M p __VEC_SOA_MAP_6(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_8(M, p, ...) M p __VEC_SOA_MAP_7(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_9(M, p, ...) M p __VEC_SOA_MAP_8(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_10(M, p, ...) M p __VEC_SOA_MAP_9(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_11(M, p, ...) M p __VEC_SOA_MAP_10(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_12(M, p, ...) M p __VEC_SOA_MAP_11(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_13(M, p, ...) M p __VEC_SOA_MAP_12(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_14(M, p, ...) M p __VEC_SOA_MAP_13(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_15(M, p, ...) M p __VEC_SOA_MAP_14(M, __VA_ARGS__)
+#define __VEC_SOA_MAP_16(M, p, ...) M p __VEC_SOA_MAP_15(M, __VA_ARGS__)
+
+#define __VEC_SOA_COLUMN(T, f) T *f;
+#define __VEC_SOA_SIZE(T, f) sizeof(T),
+#define __VEC_SOA_PARAM(T, f) , T f
+#define __VEC_SOA_STORE(T, f) __vec_soa->f[__vec_idx] = f;
+
+// The columns are anonymous members of a union with the array of columns,
+// which is standard since C11. GCC, Clang and MSVC also accept it in older
+// modes, as an extension.
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define __vec_soa_extension
+#elif defined(__GNUC__) || defined(__clang__)
+#define __vec_soa_extension __extension__
+#elif defined(_MSC_VER)
+#define __vec_soa_extension
+#else
+#define __VEC_SOA_UNSUPPORTED
+#endif
+
+/*!
+ * \brief Declares `Name##_soa_t`, a vector that stores every field in its own
+ * column, and `static inline` functions to use it.
+ * \details Fields are given as `(type, name)` pairs, up to 16 of them. Every
+ * column is aligned to `VEC_CACHE_LINE` and is reached directly through the
+ * field's name; all columns share one length and capacity and grow together
+ * with the same policy as `vec_push()`. Elements are copied bit for bit.
+ *
+ * Sample usage:
+ * ```
+ * VEC_SOA_DECLARE(Particle, (float, x), (float, y), (uint32_t, color))
+ *
+ * Particle_soa_t ps;
+ * Particle_soa_init(&ps, NULL);           // NULL selects the default allocator
+ * Particle_soa_push(&ps, 1.0f, 2.0f, 0xff); // One argument per field
+ * float *x;
+ * vec_soa_foreach(x, &ps, x) {            // Only touches the `x` column
+ *   *x += 1.0f;
+ * }
+ * Particle_soa_swap_remove(&ps, 0);
+ * Particle_soa_fini(&ps);
+ * ```
+ *
+ * *Note*: the columns are anonymous struct and union members, which need C11
+ * or a compiler that supports them as an extension (GCC, Clang, MSVC). With
+ * any other compiler, `VEC_SOA_DECLARE()` fails to compile.
+ */
+#ifdef __VEC_SOA_UNSUPPORTED
+#define VEC_SOA_DECLARE(Name, ...)                                        \
+  typedef char Name##_soa_requires_c11_anonymous_members[-1];
+#else
+#define VEC_SOA_DECLARE(Name, ...)                                        \
+  typedef struct Name##_soa_t {                                           \
+    vec_soa_t soa;                                                        \
+    __vec_soa_extension union {                                           \
+      __vec_soa_extension struct {                                        \
+        __VEC_SOA_MAP(__VEC_SOA_COLUMN, __VA_ARGS__)                      \
+      };                                                                  \
+      void *columns[__VEC_SOA_NARG(__VA_ARGS__)];                         \
+    };                                                                    \
+  } Name##_soa_t;                                                         \
+                                                                          \
+  static inline vec_error_t                                               \
+  Name##_soa_init(                                                        \
+      Name##_soa_t *s,                                                    \
+      const vec_allocator_t *allocator)                                   \
+  {                                                                       \
+    static const size_t sizes[] = {                                       \
+      __VEC_SOA_MAP(__VEC_SOA_SIZE, __VA_ARGS__)                          \
+    };                                                                    \
+    return vec_soa_init_impl(&s->soa, __vec_arr_size(sizes), sizes,       \
+        s->columns, allocator);                                           \
+  }                                                                       \
+                                                                          \
+  static inline void                                                      \
+  Name##_soa_fini(                                                        \
+      Name##_soa_t *s)                                                    \
+  {                                                                       \
+    vec_soa_fini_impl(&s->soa, s->columns);                               \
+  }                                                                       \
+                                                                          \
+  static inline vec_error_t                                               \
+  Name##_soa_reserve(                                                     \
+      Name##_soa_t *s,                                                    \
+      size_t n)                                                           \
+  {                                                                       \
+    if (n <= s->soa.capacity) {                                           \
+      return VEC_ERR_NONE;                                                \
+    }                                                                     \
+    return vec_soa_setcapacity_impl(&s->soa, s->columns, n);              \
+  }                                                                       \
+                                                                          \
+  static inline int                                                       \
+  Name##_soa_push(                                                        \
+      Name##_soa_t *__vec_soa                                             \
+      __VEC_SOA_MAP(__VEC_SOA_PARAM, __VA_ARGS__))                        \
+  {                                                                       \
+    int __vec_idx = vec_soa_push_impl(&__vec_soa->soa, __vec_soa->columns); \
+    if (__vec_idx < 0) {                                                  \
+      return __vec_idx;                                                   \
+    }                                                                     \
+    __VEC_SOA_MAP(__VEC_SOA_STORE, __VA_ARGS__)                           \
+    return __vec_idx;                                                     \
+  }                                                                       \
+                                                                          \
+  static inline vec_error_t                                               \
+  Name##_soa_swap_remove(                                                 \
+      Name##_soa_t *s,                                                    \
+      size_t idx)                                                         \
+  {                                                                       \
+    return vec_soa_swap_remove_impl(&s->soa, s->columns, idx);            \
+  }                                                                       \
+                                                                          \
+  static inline size_t                                                    \
+  Name##_soa_len(                                                         \
+      const Name##_soa_t *s)                                              \
+  {                                                                       \
+    return s->soa.length;                                                 \
+  }
+#endif
+
+/*!
+ * \brief Loops `ref` over the column `field` of the structure-of-arrays vector
+ * `s` (a pointer), like `vec_foreach()`. `ref` must be declared beforehand.
+ */
+#define vec_soa_foreach(ref, s, field) \
+  for(ref = (s)->field; ref < (s)->field + (s)->soa.length; ++ref)
+
+/*!
+ * \brief Bounded FIFO queue between exactly one producer thread and one
+ * consumer thread, without locks.
+ * \details The elements live in a regular vector whose capacity is a power of
+ * two, so positions wrap with a mask. `head` and `tail` only ever grow and
+ * each one is written by a single side; both sit on their own cache line
+ * together with that side's cached copy of the other index, so the two
+ * threads only touch each other's line when the cached copy runs out.
+ * Elements are copied bit for bit.
+ *
+ * Sample usage:
+ * ```
+ * vec_ring_t q;
+ * vec_ring_init(&q, sizeof(frame_t), 1024, NULL);
+ * // Producer thread:
+ * size_t sent = vec_ring_push_n(&q, frames, count);
+ * // Consumer thread:
+ * frame_t f;
+ * while(vec_ring_pop(&q, &f) == VEC_ERR_NONE) { ... }
+ * ```
+ */
+typedef struct vec_ring_t {
+  //! Storage of the ring. Its capacity is the capacity of the ring.
+  __vec_align(VEC_CACHE_LINE) vec_t buf;
+  //! `capacity - 1`.
+  size_t mask;
+  //! The size (in bytes) of memory that each element takes.
+  size_t elemsize;
+  //! Number of elements popped so far. Only written by the consumer.
+  __vec_align(VEC_CACHE_LINE) size_t head;
+  //! The consumer's latest view of `tail`.
+  size_t tail_cache;
+  //! Number of elements pushed so far. Only written by the producer.
+  __vec_align(VEC_CACHE_LINE) size_t tail;
+  //! The producer's latest view of `head`.
+  size_t head_cache;
+} vec_ring_t;
+
+/*!
+ * \brief Initializes an empty ring.
+ *
+ * \param r The ring object to initialize
+ * \param elemsize Memory (in bytes) that should be reserved per element in the ring
+ * \param capacity Minimum number of elements the ring can hold, rounded up to
+ * a power of two
+ * \param destr A function pointer to the function that should be used to destroy
+ * the elements that are left in the ring by `vec_ring_fini()`. Can be NULL
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_ring_init(
+  vec_ring_t *r,
+  size_t elemsize,
+  size_t capacity,
+  elem_destr destr);
+
+/*!
+ * \brief Destroys the elements that are still queued and releases the ring's
+ * storage. Neither side may use the ring concurrently.
+ *
+ * \param r The ring object
+ */
+VEC_API void
+vec_ring_fini(
+  vec_ring_t *r);
+
+/*!
+ * \brief Copies a value to the back of the ring. Producer only.
+ *
+ * \param r The ring object
+ * \param val A pointer to the element that is to be copied into the ring
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the ring is full
+ */
+VEC_API vec_error_t
+vec_ring_push(
+  vec_ring_t *r,
+  const void *val);
+
+/*!
+ * \brief Copies as many of `n` contiguous elements as fit to the back of the
+ * ring, with at most two memcpys and a single publication. Producer only.
+ *
+ * \param r The ring object
+ * \param vals A pointer to the first of the elements
+ * \param n Number of elements in `vals`
+ *
+ * \returns The number of elements that were pushed
+ */
+VEC_API size_t
+vec_ring_push_n(
+  vec_ring_t *r,
+  const void *vals,
+  size_t n);
+
+/*!
+ * \brief Removes the element at the front of the ring. Consumer only.
+ *
+ * \param r The ring object
+ * \param out A pointer to the memory block at which the popped element will be
+ * copied. If NULL is passed, then the element is destructed.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the ring is empty
+ */
+VEC_API vec_error_t
+vec_ring_pop(
+  vec_ring_t *r,
+  void *out);
+
+/*!
+ * \brief Removes up to `n` elements from the front of the ring, with at most
+ * two memcpys and a single publication. Consumer only.
+ *
+ * \param r The ring object
+ * \param out A pointer to room for `n` elements. If NULL is passed, then the
+ * popped elements are destructed.
+ * \param n Maximum number of elements to pop
+ *
+ * \returns The number of elements that were popped
+ */
+VEC_API size_t
+vec_ring_pop_n(
+  vec_ring_t *r,
+  void *out,
+  size_t n);
+
+/*!
+ * \param r The ring object
+ *
+ * \returns The number of queued elements. Exact on either side when the other
+ * one is idle, a snapshot otherwise.
+ */
+VEC_API size_t
+vec_ring_len(
+  vec_ring_t *r);
+
+/*!
+ * \param r The ring object
+ *
+ * \returns The number of elements the ring can hold
+ */
+VEC_API size_t
+vec_ring_capacity(
+  vec_ring_t *r);
+
+/*!
+ * \brief Double-ended queue with O(1) pushes and pops at both ends.
+ * \details The elements live in a circular buffer: a regular vector whose
+ * capacity is a power of two, so it carries the element size, the element
+ * functions and the allocator in its metadata. Elements are copied in and out
+ * the same way as with `vec_push()` and `vec_pop()`. `vec_deque_linearize()`
+ * hands the contents back as a plain vector.
+ *
+ * Sample usage:
+ * ```
+ * vec_deque_t frontier;
+ * vec_deque_init(&frontier, sizeof(node_t), NULL, NULL);
+ * vec_deque_push_back(&frontier, &root);
+ * node_t n;
+ * while(vec_deque_pop_front(&frontier, &n) == VEC_ERR_NONE) {
+ *   ...
+ * }
+ * vec_deque_fini(&frontier);
+ * ```
+ */
+typedef struct vec_deque_t {
+  //! The circular buffer. Its own length is not used and stays 0.
+  vec_t buf;
+  //! Index in `buf` of the first element.
+  size_t head;
+  //! The number of elements in the deque.
+  size_t length;
+} vec_deque_t;
+
+/*!
+ * \brief Initializes an empty deque.
+ *
+ * \param d The deque object to initialize
+ * \param elemsize Memory (in bytes) that should be reserved per element in the deque
+ * \param copy A function pointer to the function that should be used to copy an element
+ * to and from the deque. Can be NULL
+ * \param destr A function pointer to the function that should be used to destroy a
+ * deque element. Can be NULL
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_deque_init(
+  vec_deque_t *d,
+  size_t elemsize,
+  elem_copy copy,
+  elem_destr destr);
+
+/*!
+ * \brief Destroys every element and releases the buffer.
+ *
+ * \param d The deque object
+ */
+VEC_API void
+vec_deque_fini(
+  vec_deque_t *d);
+
+/*!
+ * \brief Copies a value to the back of the deque, doubling the buffer if it
+ * is full.
+ *
+ * \param d The deque object
+ * \param val A pointer to the element that is to be copied into the deque
+ *
+ * \returns The index of the element that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_deque_push_back(
+  vec_deque_t *d,
+  const void *val);
+
+/*!
+ * \brief Copies a value to the front of the deque, doubling the buffer if it
+ * is full. The indices of the other elements grow by one.
+ *
+ * \param d The deque object
+ * \param val A pointer to the element that is to be copied into the deque
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_deque_push_front(
+  vec_deque_t *d,
+  const void *val);
+
+/*!
+ * \brief Same as `vec_pop()`, for the last element of the deque.
+ *
+ * \param d The deque object
+ * \param out A pointer to the memory block at which the popped element will be
+ * copied. If NULL is passed, then the element is destructed.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the deque
+ * is empty
+ */
+VEC_API vec_error_t
+vec_deque_pop_back(
+  vec_deque_t *d,
+  void *out);
+
+/*!
+ * \brief Same as `vec_pop()`, for the first element of the deque.
+ *
+ * \param d The deque object
+ * \param out A pointer to the memory block at which the popped element will be
+ * copied. If NULL is passed, then the element is destructed.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the deque
+ * is empty
+ */
+VEC_API vec_error_t
+vec_deque_pop_front(
+  vec_deque_t *d,
+  void *out);
+
+/*!
+ * \param d The deque object
+ * \param idx Index of the element, counted from the front
+ *
+ * \returns A pointer to the element at `idx`, or NULL if `idx` is out of bounds
+ */
+VEC_API void *
+vec_deque_at(
+  vec_deque_t *d,
+  size_t idx);
+
+/*!
+ * \param d The deque object
+ *
+ * \returns Current length of the deque
+ */
+VEC_API size_t
+vec_deque_len(
+  vec_deque_t *d);
+
+/*!
+ * \brief Makes sure that the deque can hold at least `n` elements without any
+ * further reallocation.
+ *
+ * \param d The deque object
+ * \param n The number of elements that should fit in the deque
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on OOM
+ */
+VEC_API vec_error_t
+vec_deque_reserve(
+  vec_deque_t *d,
+  size_t n);
+
+/*!
+ * \brief Turns the deque into a plain vector holding its elements from front
+ * to back. If the elements do not wrap around the end of the buffer, they are
+ * moved to its start and the buffer itself is returned; otherwise they are
+ * relocated into a new one. Afterwards `d` is finished and must be
+ * initialized again before it is reused.
+ *
+ * \param d The deque object
+ *
+ * \returns The vector. NULL on OOM, in which case `d` is left unchanged.
+ */
+VEC_API vec_t
+vec_deque_linearize(
+  vec_deque_t *d);
+
+/*!
+ * \brief Vector of bits, 64 to a word.
+ * \details The words are kept in a regular `vec(uint64_t)`, so they grow with
+ * the same policy as `vec_push()`. Bits past the length are always 0.
+ *
+ * Sample usage:
+ * ```
+ * vec_bits_t visible;
+ * vec_bits_init(&visible);
+ * vec_bits_setlen(&visible, entity_count);  // All bits start at 0
+ * vec_bits_set(&visible, 42, 1);
+ * size_t shown = vec_bits_popcount(&visible);
+ * for(ptrdiff_t i = vec_bits_find_first(&visible, 0); i >= 0;
+ *     i = vec_bits_find_first(&visible, (size_t)i + 1)) {
+ *   ...
+ * }
+ * vec_bits_fini(&visible);
+ * ```
+ */
+typedef struct vec_bits_t {
+  //! Storage of the bits, as a `vec(uint64_t)`. Bit `i` is bit `i % 64` of word `i / 64`.
+  vec_t words;
+  //! The number of bits in the vector.
+  size_t length;
+} vec_bits_t;
+
+/*!
+ * \brief Initializes an empty bit vector.
+ *
+ * \param b The bit vector object to initialize
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_bits_init(
+  vec_bits_t *b);
+
+/*!
+ * \brief Releases the memory of the bit vector.
+ *
+ * \param b The bit vector object
+ */
+VEC_API void
+vec_bits_fini(
+  vec_bits_t *b);
+
+/*!
+ * \brief Appends a bit to the end of the vector.
+ *
+ * \param b The bit vector object
+ * \param bit The value of the new bit; any non-zero value sets it
+ *
+ * \returns The index of the bit that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_bits_push(
+  vec_bits_t *b,
+  int bit);
+
+/*!
+ * \brief Same as `vec_setlen()`. Bits added at the end are 0.
+ *
+ * \param b The bit vector object
+ * \param len The desired new length, in bits
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_bits_setlen(
+  vec_bits_t *b,
+  size_t len);
+
+/*!
+ * \param b The bit vector object
+ *
+ * \returns Current length of the vector, in bits
+ */
+VEC_API size_t
+vec_bits_len(
+  const vec_bits_t *b);
+
+/*!
+ * \param b The bit vector object
+ *
+ * \returns The number of bits that are set
+ */
+VEC_API size_t
+vec_bits_popcount(
+  const vec_bits_t *b);
+
+/*!
+ * \param b The bit vector object
+ * \param from Index of the first bit to look at
+ *
+ * \returns The index of the first set bit at or after `from`, -1 if there is none
+ */
+VEC_API ptrdiff_t
+vec_bits_find_first(
+  const vec_bits_t *b,
+  size_t from);
+
+/*!
+ * \param b The bit vector object
+ * \param idx Index of the bit. Must be less than the length of the vector
+ *
+ * \returns 1 if the bit at `idx` is set, 0 otherwise
+ */
+static inline int
+vec_bits_get(
+    const vec_bits_t *b,
+    size_t idx)
+{
+  return (int)((((const uint64_t *)b->words)[idx / 64] >> (idx % 64)) & 1);
+}
+
+/*!
+ * \param b The bit vector object
+ * \param idx Index of the bit. Must be less than the length of the vector
+ * \param bit The new value of the bit; any non-zero value sets it
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the words were shared
+ * (see `vec_share()`) and could not be copied
+ */
+static inline vec_error_t
+vec_bits_set(
+    vec_bits_t *b,
+    size_t idx,
+    int bit)
+{
+  if(__vec_is_shared(__vec_hdr(b->words)) && vec_unshare(&b->words)) {
+    return VEC_ERR_OOM;
+  }
+  uint64_t *word = (uint64_t *)b->words + (idx / 64);
+  uint64_t mask  = (uint64_t)1 << (idx % 64);
+  *word = bit ? (*word | mask) : (*word & ~mask);
+  return VEC_ERR_NONE;
+}
+
+/*!
+ * \brief Vector of unsigned integers that are all stored in the same number
+ * of bits, between 1 and 32, without any padding between them.
+ * \details Elements are packed into 64-bit words and may straddle two of them.
+ * `vec_packed_get_n()` and `vec_packed_set_n()` convert whole ranges from and
+ * to `uint32_t` arrays with shifts on a running word, which is much faster
+ * than going element by element.
+ *
+ * Sample usage:
+ * ```
+ * vec_packed_t ids;
+ * vec_packed_init(&ids, 10);               // Values below 1024
+ * vec_packed_append(&ids, src, count);     // From a uint32_t array
+ * uint32_t id = vec_packed_get(&ids, 7);
+ * vec_packed_get_n(&ids, 0, dst, count);   // Back to a uint32_t array
+ * vec_packed_fini(&ids);
+ * ```
+ */
+typedef struct vec_packed_t {
+  //! Storage of the elements, as a `vec(uint64_t)`. There is always one more
+  //! word past the last one in use, which is 0.
+  vec_t words;
+  //! The number of elements in the vector.
+  size_t length;
+  //! Number of bits per element.
+  unsigned bits;
+} vec_packed_t;
+
+/*!
+ * \brief Initializes an empty packed vector.
+ *
+ * \param p The packed vector object to initialize
+ * \param bits Number of bits per element, between 1 and 32. Values are
+ * truncated to their lowest `bits` bits when they are stored.
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure,
+ * `VEC_ERR_OUT_OF_BOUNDS` if `bits` is not supported
+ */
+VEC_API vec_error_t
+vec_packed_init(
+  vec_packed_t *p,
+  unsigned bits);
+
+/*!
+ * \brief Releases the memory of the packed vector.
+ *
+ * \param p The packed vector object
+ */
+VEC_API void
+vec_packed_fini(
+  vec_packed_t *p);
+
+/*!
+ * \brief Appends a value to the end of the vector.
+ *
+ * \param p The packed vector object
+ * \param val The value to append
+ *
+ * \returns The index of the value that was just pushed. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_packed_push(
+  vec_packed_t *p,
+  uint32_t val);
+
+/*!
+ * \brief Same as `vec_append()`: packs `n` values to the end of the vector
+ * with a single reservation.
+ *
+ * \param p The packed vector object
+ * \param vals The values to append
+ * \param n Number of values in `vals`
+ *
+ * \returns The index of the first value that was appended. If the operation
+ * failed, a non-zero (vec_error_t) value is returned.
+ */
+VEC_API int
+vec_packed_append(
+  vec_packed_t *p,
+  const uint32_t *vals,
+  size_t n);
+
+/*!
+ * \param p The packed vector object
+ * \param idx Index of the element. Must be less than the length of the vector
+ *
+ * \returns The value of the element at `idx`
+ */
+VEC_API uint32_t
+vec_packed_get(
+  const vec_packed_t *p,
+  size_t idx);
+
+/*!
+ * \param p The packed vector object
+ * \param idx Index of the element. Must be less than the length of the vector
+ * \param val The new value of the element
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` if the words were shared
+ * (see `vec_share()`) and could not be copied
+ */
+VEC_API vec_error_t
+vec_packed_set(
+  vec_packed_t *p,
+  size_t idx,
+  uint32_t val);
+
+/*!
+ * \brief Unpacks the elements `[first, first + n)` into an array.
+ *
+ * \param p The packed vector object
+ * \param first Index of the first element
+ * \param out Room for `n` values
+ * \param n Number of elements
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the range
+ * does not lie within the vector
+ */
+VEC_API vec_error_t
+vec_packed_get_n(
+  const vec_packed_t *p,
+  size_t first,
+  uint32_t *out,
+  size_t n);
+
+/*!
+ * \brief Packs an array into the elements `[first, first + n)`.
+ *
+ * \param p The packed vector object
+ * \param first Index of the first element
+ * \param vals The new values
+ * \param n Number of elements
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OUT_OF_BOUNDS` if the range
+ * does not lie within the vector, `VEC_ERR_OOM` if the words were shared (see
+ * `vec_share()`) and could not be copied
+ */
+VEC_API vec_error_t
+vec_packed_set_n(
+  vec_packed_t *p,
+  size_t first,
+  const uint32_t *vals,
+  size_t n);
+
+/*!
+ * \brief Same as `vec_setlen()`. Elements added at the end are 0.
+ *
+ * \param p The packed vector object
+ * \param len The desired new length
+ *
+ * \returns `VEC_ERR_NONE` on success, `VEC_ERR_OOM` on allocation failure
+ */
+VEC_API vec_error_t
+vec_packed_setlen(
+  vec_packed_t *p,
+  size_t len);
+
+/*!
+ * \param p The packed vector object
+ *
+ * \returns Current length of the vector
+ */
+VEC_API size_t
+vec_packed_len(
+  const vec_packed_t *p);
+
+#ifdef VEC_IMPLEMENTATION
+#undef VEC_IMPLEMENTATION
+
+#ifdef VEC_API_CHECK
+#define API_CHECK(x) do { x; } while(0)
+#define __VEC_META_MAGIC .magic = __VEC_MAGIC_LIVE,
+#else
+#define API_CHECK(x)
+#define __VEC_META_MAGIC
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The first element follows the header, so the header must end on a
+// `__VEC_MAX_ALIGN` boundary.
+typedef char __vec_meta_size_check[sizeof(struct vec_meta_t) % __VEC_MAX_ALIGN == 0 ? 1 : -1];
+
+#define vec_meta(v) \
+  ((struct vec_meta_t *)v) - 1
+
+#define __GET_METADATA__(v) \
+  struct vec_meta_t *metadata = ((struct vec_meta_t *)(v)) - 1; \
+  API_CHECK(__vec_check_meta(metadata, __func__));
+
+#define __SYNC_METADATA__(v) \
+  metadata = ((struct vec_meta_t *)(v)) - 1;
+
+/*
+ * Makes `*v` the only owner of its buffer before it is modified, copying the
+ * buffer if other handles share it (see `vec_share()`). Returns `fail` from
+ * the calling function if the copy cannot be allocated.
+ */
+#define __VEC_UNSHARE_OR__(v, fail) \
+  if(__vec_is_shared(metadata)) { \
+    if(vec_unshare(v)) { \
+      return fail; \
+    } \
+    __SYNC_METADATA__(*v) \
+  }
+
+#ifdef VEC_API_CHECK
+static void
+__vec_check_report(
+    const char *func,
+    const char *msg,
+    const void *v)
+{
+  fprintf(stderr, "vec: %s: %s (vector %p)\n", func, msg, v);
+  abort();
+}
+
+static vec_check_fn __vec_check_handler = __vec_check_report;
+
+static void
+__vec_check_meta(
+    const struct vec_meta_t *metadata,
+    const char *func)
+{
+  const char *msg = NULL;
+  if(metadata->magic == __VEC_MAGIC_DEAD) {
+    msg = "use after vec_fini()";
+  } else if(metadata->magic != __VEC_MAGIC_LIVE) {
+    msg = "not a vector, or its header was overwritten";
+  } else if(metadata->length > metadata->capacity) {
+    msg = "length exceeds capacity";
+  } else if(metadata->allocationType > VEC_ALLOCATION_TYPE_MAPPED) {
+    msg = "invalid allocation type";
+  } else if((uintptr_t)(metadata + 1) % __VEC_MAX_ALIGN) {
+    msg = "first element is not aligned to max_align_t";
+  }
+  if(msg) {
+    __vec_check_handler(func, msg, metadata + 1);
+  }
+}
+
+// Fills `count` vacated slots starting at index `first`.
+static void
+__vec_check_poison(
+    struct vec_meta_t *metadata,
+    size_t first,
+    size_t count)
+{
+  // Mapped vectors may be backed by the file itself.
+  if(metadata->allocationType != VEC_ALLOCATION_TYPE_MAPPED) {
+    memset((char *)(metadata + 1) + (first * metadata->elemsize), VEC_POISON_BYTE,
+        count * metadata->elemsize);
+  }
+}
+#endif
+
+vec_check_fn
+vec_set_check_fn(
+    vec_check_fn fn)
+{
+#ifdef VEC_API_CHECK
+  vec_check_fn old = __vec_check_handler;
+  __vec_check_handler = fn ? fn : __vec_check_report;
+  return old;
+#else
+  (void)fn;
+  return NULL;
+#endif
+}
+
+/*
+ * Minimal set of atomic operations on `size_t`, plus an addition on
+ * `uint32_t` for the owner count of shared vectors and loads and stores of
+ * `unsigned char` for the ready flags of concurrent vectors. The memory order
+ * arguments are ignored on MSVC, where every interlocked operation is a full
+ * barrier.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define __VEC_RELAXED 0
+#define __VEC_ACQUIRE 0
+#define __VEC_RELEASE 0
+#define __VEC_SEQ_CST 0
+#ifdef _WIN64
+#define __vec_atomic_fetch_add(p, x, order) \
+  ((size_t)_InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(x)))
+#define __vec_atomic_load(p, order) \
+  ((size_t)_InterlockedOr64((volatile __int64 *)(p), 0))
+#define __vec_atomic_store(p, x, order) \
+  ((void)_InterlockedExchange64((volatile __int64 *)(p), (__int64)(x)))
+#define __vec_atomic_cas(p, expected, desired, order) \
+  (_InterlockedCompareExchange64((volatile __int64 *)(p), (__int64)(desired), (__int64)(expected)) == (__int64)(expected))
+#else
+#define __vec_atomic_fetch_add(p, x, order) \
+  ((size_t)_InterlockedExchangeAdd((volatile long *)(p), (long)(x)))
+#define __vec_atomic_load(p, order) \
+  ((size_t)_InterlockedOr((volatile long *)(p), 0))
+#define __vec_atomic_store(p, x, order) \
+  ((void)_InterlockedExchange((volatile long *)(p), (long)(x)))
+#define __vec_atomic_cas(p, expected, desired, order) \
+  (_InterlockedCompareExchange((volatile long *)(p), (long)(desired), (long)(expected)) == (long)(expected))
+#endif
+#define __vec_atomic_fetch_add32(p, x, order) \
+  ((uint32_t)_InterlockedExchangeAdd((volatile long *)(p), (long)(x)))
+#define __vec_atomic_load8(p, order) \
+  ((unsigned char)_InterlockedOr8((volatile char *)(p), 0))
+#define __vec_atomic_store8(p, x, order) \
+  ((void)_InterlockedExchange8((volatile char *)(p), (char)(x)))
+#define __vec_atomic_load_ptr(p, order) \
+  _InterlockedCompareExchangePointer((void *volatile *)(p), NULL, NULL)
+#define __vec_atomic_exchange_ptr(p, x, order) \
+  _InterlockedExchangePointer((void *volatile *)(p), (x))
+#define __vec_atomic_cas_ptr(p, expected, desired, order) \
+  (_InterlockedCompareExchangePointer((void *volatile *)(p), (desired), (expected)) == (expected))
+#else
+#define __VEC_RELAXED __ATOMIC_RELAXED
+#define __VEC_ACQUIRE __ATOMIC_ACQUIRE
+#define __VEC_RELEASE __ATOMIC_RELEASE
+#define __VEC_SEQ_CST __ATOMIC_SEQ_CST
+#define __vec_atomic_fetch_add(p, x, order) __atomic_fetch_add((p), (x), order)
+#define __vec_atomic_fetch_add32(p, x, order) __atomic_fetch_add((p), (x), order)
+#define __vec_atomic_load8(p, order) __atomic_load_n((p), order)
+#define __vec_atomic_store8(p, x, order) __atomic_store_n((p), (x), order)
+#define __vec_atomic_load(p, order) __atomic_load_n((p), order)
+#define __vec_atomic_store(p, x, order) __atomic_store_n((p), (x), order)
+#define __vec_atomic_cas(p, expected, desired, order) \
+  __extension__({ size_t __vec_exp = (expected); \
+     __atomic_compare_exchange_n((p), &__vec_exp, (desired), 0, order, __ATOMIC_RELAXED); })
+#define __vec_atomic_load_ptr(p, order) __atomic_load_n((p), order)
+#define __vec_atomic_exchange_ptr(p, x, order) __atomic_exchange_n((p), (x), order)
+#define __vec_atomic_cas_ptr(p, expected, desired, order) \
+  __extension__({ void *__vec_exp = (expected); \
+     __atomic_compare_exchange_n((p), &__vec_exp, (desired), 0, order, __ATOMIC_ACQUIRE); })
+#endif
+
+#ifdef VEC_STATS
+static vec_stats_t __vec_global_stats;
+
+static void
+__vec_stats_max(
+    size_t *counter,
+    size_t value)
+{
+  size_t current = __vec_atomic_load(counter, __VEC_RELAXED);
+  while(value > current) {
+    if(__vec_atomic_cas(counter, current, value, __VEC_RELAXED)) {
+      break;
+    }
+    current = __vec_atomic_load(counter, __VEC_RELAXED);
+  }
+}
+
+static void
+__vec_stats_length(
+    struct vec_meta_t *metadata,
+    size_t len)
+{
+  if(len > metadata->stats.peak_length) {
+    metadata->stats.peak_length = len;
+    __vec_stats_max(&__vec_global_stats.peak_length, len);
+  }
+}
+
+void
+__vec_stats_push(
+    struct vec_meta_t *metadata,
+    size_t count)
+{
+  metadata->stats.pushes += count;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, count, __VEC_RELAXED);
+  __vec_stats_length(metadata, metadata->length + count);
+}
+
+static void
+__vec_stats_resize(
+    struct vec_meta_t *metadata,
+    size_t old_cap,
+    int moved,
+    size_t bytes_moved)
+{
+  if(metadata->capacity > old_cap) {
+    metadata->stats.grows++;
+    __vec_atomic_fetch_add(&__vec_global_stats.grows, 1, __VEC_RELAXED);
+  }
+  if(moved) {
+    metadata->stats.realloc_moves++;
+    metadata->stats.bytes_moved += bytes_moved;
+    __vec_atomic_fetch_add(&__vec_global_stats.realloc_moves, 1, __VEC_RELAXED);
+    __vec_atomic_fetch_add(&__vec_global_stats.bytes_moved, bytes_moved, __VEC_RELAXED);
+  } else {
+    metadata->stats.inplace_extends++;
+    __vec_atomic_fetch_add(&__vec_global_stats.inplace_extends, 1, __VEC_RELAXED);
+  }
+  if(metadata->capacity > metadata->stats.peak_capacity) {
+    metadata->stats.peak_capacity = metadata->capacity;
+    __vec_stats_max(&__vec_global_stats.peak_capacity, metadata->capacity);
+  }
+}
+
+vec_stats_t
+vec_stats_get(
+    vec_t v)
+{
+  vec_stats_t stats;
+  if(v) {
+    __GET_METADATA__(v)
+    stats = metadata->stats;
+    stats.wasted_bytes = (metadata->capacity - metadata->length) * metadata->elemsize;
+  } else {
+    stats = (vec_stats_t){
+      .pushes          = __vec_atomic_load(&__vec_global_stats.pushes, __VEC_RELAXED),
+      .grows           = __vec_atomic_load(&__vec_global_stats.grows, __VEC_RELAXED),
+      .realloc_moves   = __vec_atomic_load(&__vec_global_stats.realloc_moves, __VEC_RELAXED),
+      .inplace_extends = __vec_atomic_load(&__vec_global_stats.inplace_extends, __VEC_RELAXED),
+      .bytes_moved     = __vec_atomic_load(&__vec_global_stats.bytes_moved, __VEC_RELAXED),
+      .peak_length     = __vec_atomic_load(&__vec_global_stats.peak_length, __VEC_RELAXED),
+      .peak_capacity   = __vec_atomic_load(&__vec_global_stats.peak_capacity, __VEC_RELAXED),
+      .wasted_bytes    = 0,
+    };
+  }
+  return stats;
+}
+
+void
+vec_stats_reset(
+    vec_t v)
+{
+  if(v) {
+    __GET_METADATA__(v)
+    metadata->stats = (vec_stats_t){ 0 };
+  } else {
+    __vec_atomic_store(&__vec_global_stats.pushes, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.grows, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.realloc_moves, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.inplace_extends, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.bytes_moved, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.peak_length, 0, __VEC_RELAXED);
+    __vec_atomic_store(&__vec_global_stats.peak_capacity, 0, __VEC_RELAXED);
+  }
+}
+
+void
+vec_stats_dump(
+    vec_t v,
+    FILE *out)
+{
+  vec_stats_t stats = vec_stats_get(v);
+  fprintf(out,
+      "vec stats (%s):\n"
+      "  pushes          %zu\n"
+      "  grows           %zu\n"
+      "  realloc moves   %zu\n"
+      "  in-place resize %zu\n"
+      "  bytes moved     %zu\n"
+      "  peak length     %zu\n"
+      "  peak capacity   %zu\n"
+      "  wasted bytes    %zu\n",
+      v ? "vector" : "global",
+      stats.pushes, stats.grows, stats.realloc_moves, stats.inplace_extends,
+      stats.bytes_moved, stats.peak_length, stats.peak_capacity, stats.wasted_bytes);
+}
+#endif
+
+/*
+ * Relocates `n` elements from `src` to `dst`, which may overlap. Elements are
+ * moved one at a time through the move function if the vector has one, and
+ * with a single memmove otherwise.
+ */
+static void
+__vec_relocate(
+    struct vec_meta_t *metadata,
+    void *dst,
+    void *src,
+    size_t n)
+{
+  if(!__vec_meta_move_fn(metadata)) {
+    memmove(dst, src, n * metadata->elemsize);
+    return;
+  }
+
+  size_t elemsize = metadata->elemsize;
+  if((char *)dst < (char *)src) {
+    for(size_t i = 0; i < n; i++) {
+      __vec_meta_move_fn(metadata)((char *)dst + (i * elemsize), (char *)src + (i * elemsize));
+    }
+  } else if((char *)dst > (char *)src) {
+    for(size_t i = n; i > 0; i--) {
+      __vec_meta_move_fn(metadata)((char *)dst + ((i - 1) * elemsize), (char *)src + ((i - 1) * elemsize));
+    }
+  }
+}
+
+/*
+ * Applies the vector's shrink policy after its length was reduced. Failing to
+ * shrink is not an error, the vector simply keeps its capacity.
+ */
+static void
+__vec_maybe_shrink(
+    vec_t *v)
+{
+  __GET_METADATA__(*v)
+
+  if(metadata->shrink_policy == VEC_SHRINK_HYSTERESIS &&
+     (metadata->allocationType == VEC_ALLOCATION_TYPE_HEAP ||
+      metadata->allocationType == VEC_ALLOCATION_TYPE_RESERVED) &&
+     metadata->capacity > VEC_INIT_CAP &&
+     metadata->length < metadata->capacity / 4) {
+    size_t cap = metadata->capacity / 2;
+    (void)vec_setcapacity(v, cap > VEC_INIT_CAP ? cap : VEC_INIT_CAP);
+  }
+}
+
+/*
+ * Returns the capacity that the growth policy settles on for a vector of
+ * capacity `cap` that needs to hold `required` elements. Only arithmetic is
+ * done here, so callers can reallocate once instead of growing step by step.
+ */
+static size_t
+__vec_next_capacity(
+    size_t cap,
+    size_t required)
+{
+  size_t next = cap ? cap : 1;
+  while(next < required) {
+    if(next > SIZE_MAX / 2) {
+      return required;
+    }
+#ifdef VEC_GROWTH_POW2
+    next = next << 1;
+#else
+    size_t grown = next * VEC_GROWTH_RATE;
+    next = grown > next ? grown : next + 1;
+#endif
+  }
+#ifdef VEC_GROWTH_POW2
+  if(next & (next - 1)) {
+    while(next & (next - 1)) {
+      next &= next - 1;
+    }
+    next = next << 1;
+  }
+#endif
+  if(next > VEC_MAX_CAPACITY && required <= VEC_MAX_CAPACITY) {
+    next = VEC_MAX_CAPACITY;
+  }
+  return next;
+}
+
+/*
+ * Size (in bytes) of the block that backs a heap vector with the metadata
+ * `m` and a capacity of `cap`. Aligned vectors reserve enough slack for the
+ * first element to be realigned wherever the allocator places the block.
+ */
+static size_t
+__vec_block_size(
+    const struct vec_meta_t *m,
+    size_t cap)
+{
+  size_t slack = m->alignment ? m->alignment - 1 : 0;
+  return sizeof(struct vec_meta_t) + slack + (cap * m->elemsize);
+}
+
+/*
+ * Offset (in bytes) of the first element inside a block starting at `block`.
+ */
+static size_t
+__vec_data_offset(
+    void *block,
+    size_t alignment)
+{
+  uintptr_t data = (uintptr_t)block + sizeof(struct vec_meta_t);
+  if (alignment) {
+    data = (data + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+  }
+  return (size_t)(data - (uintptr_t)block);
+}
+
+#ifdef VEC_COMPACT_META
+//! Interned type descriptors. Never freed, there is one per distinct set of
+//! functions and allocator.
+struct __vec_type_node {
+  vec_type_t type;
+  struct __vec_type_node *next;
+};
+
+static void *__vec_type_list;
+
+/*
+ * Returns the interned descriptor that is equal to `type`, creating it if
+ * there is none yet. Lookups are lock-free; racing inserts of the same
+ * descriptor may both succeed, which only costs a duplicate node.
+ */
+static const vec_type_t *
+__vec_type_intern(
+    const vec_type_t *type)
+{
+  struct __vec_type_node *fresh = NULL;
+  for(;;) {
+    struct __vec_type_node *head = (struct __vec_type_node *)__vec_atomic_load_ptr(&__vec_type_list, __VEC_ACQUIRE);
+    for(struct __vec_type_node *node = head; node; node = node->next) {
+      if(node->type.copy_fn   == type->copy_fn &&
+         node->type.destr_fn  == type->destr_fn &&
+         node->type.copy_n_fn == type->copy_n_fn &&
+         node->type.move_fn   == type->move_fn &&
+         node->type.allocator == type->allocator) {
+        free(fresh);
+        return &node->type;
+      }
+    }
+
+    if(!fresh) {
+      fresh = (struct __vec_type_node *)malloc(sizeof(*fresh));
+      if(!fresh) {
+        return NULL;
+      }
+      fresh->type = *type;
+    }
+    fresh->next = head;
+    if(__vec_atomic_cas_ptr(&__vec_type_list, (void *)head, (void *)fresh, __VEC_RELEASE)) {
+      return &fresh->type;
+    }
+  }
+}
+#endif
+
+/*
+ * Element functions and allocator of the vector, whichever way they are stored.
+ */
+static vec_type_t
+__vec_meta_type(
+    const struct vec_meta_t *metadata)
+{
+  vec_type_t type = {
+    .copy_fn   = __vec_meta_copy_fn(metadata),
+    .destr_fn  = __vec_meta_destr_fn(metadata),
+    .copy_n_fn = __vec_meta_copy_n_fn(metadata),
+    .move_fn   = __vec_meta_move_fn(metadata),
+    .allocator = __vec_meta_allocator(metadata),
+  };
+  return type;
+}
+
+/*
+ * Stores `type` in the vector's header. With `VEC_COMPACT_META`, `type` is
+ * referenced directly if `share` is set, and interned otherwise.
+ */
+static vec_error_t
+__vec_meta_set_type(
+    struct vec_meta_t *metadata,
+    const vec_type_t *type,
+    int share)
+{
+#ifdef VEC_COMPACT_META
+  if(share) {
+    metadata->type = type;
+  } else if(!type->copy_fn && !type->destr_fn && !type->copy_n_fn && !type->move_fn && !type->allocator) {
+    metadata->type = NULL;
+  } else {
+    // The old descriptor is kept on failure.
+    const vec_type_t *interned = __vec_type_intern(type);
+    if(!interned) {
+      return VEC_ERR_OOM;
+    }
+    metadata->type = interned;
+  }
+#else
+  (void)share;
+  metadata->copy_fn   = type->copy_fn;
+  metadata->destr_fn  = type->destr_fn;
+  metadata->copy_n_fn = type->copy_n_fn;
+  metadata->move_fn   = type->move_fn;
+  metadata->allocator = type->allocator;
+#endif
+  return VEC_ERR_NONE;
+}
+
+/*
+ * Virtual memory primitives of `VEC_ALLOCATION_TYPE_RESERVED` vectors. The
+ * reservation starts with a `struct __vec_reservation`, followed by the
+ * vector's header and its elements.
+ */
+#if defined(_WIN32)
+#include <windows.h>
+#define __VEC_RESERVE_SUPPORTED
+
+static void *
+__vec_os_reserve(
+    size_t *size,
+    int flags,
+    size_t *granularity)
+{
+  (void)flags;
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  *granularity = info.dwPageSize;
+  *size = (*size + (*granularity - 1)) & ~(*granularity - 1);
+  return VirtualAlloc(NULL, *size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static int
+__vec_os_commit(
+    void *addr,
+    size_t size)
+{
+  return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+static void
+__vec_os_decommit(
+    void *addr,
+    size_t size)
+{
+  VirtualFree(addr, size, MEM_DECOMMIT);
+}
+
+static void
+__vec_os_release(
+    void *addr,
+    size_t size)
+{
+  (void)size;
+  VirtualFree(addr, 0, MEM_RELEASE);
+}
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifdef MAP_ANONYMOUS
+#define __VEC_RESERVE_SUPPORTED
+#ifdef MAP_NORESERVE
+#define __VEC_MAP_NORESERVE MAP_NORESERVE
+#else
+#define __VEC_MAP_NORESERVE 0
+#endif
+
+static void *
+__vec_os_reserve(
+    size_t *size,
+    int flags,
+    size_t *granularity)
+{
+  void *addr;
+#ifdef MAP_HUGETLB
+  if(flags & VEC_RESERVE_HUGETLB) {
+    // Huge pages are reserved for the whole range up front; without that,
+    // touching a page the pool cannot back would raise SIGBUS.
+    size_t huge_size = (*size + (VEC_HUGE_PAGE_SIZE - 1)) & ~(VEC_HUGE_PAGE_SIZE - 1);
+    addr = mmap(NULL, huge_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(addr != MAP_FAILED) {
+      *size        = huge_size;
+      *granularity = VEC_HUGE_PAGE_SIZE;
+      return addr;
+    }
+  }
+#endif
+
+  *granularity = (size_t)sysconf(_SC_PAGESIZE);
+  *size = (*size + (*granularity - 1)) & ~(*granularity - 1);
+  addr = mmap(NULL, *size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | __VEC_MAP_NORESERVE, -1, 0);
+  if(addr == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if(flags & VEC_RESERVE_THP) {
+    (void)madvise(addr, *size, MADV_HUGEPAGE);
+  }
+#else
+  (void)flags;
+#endif
+  return addr;
+}
+
+static int
+__vec_os_commit(
+    void *addr,
+    size_t size)
+{
+  return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+static void
+__vec_os_decommit(
+    void *addr,
+    size_t size)
+{
+#ifdef MADV_DONTNEED
+  (void)madvise(addr, size, MADV_DONTNEED);
+#endif
+  (void)mprotect(addr, size, PROT_NONE);
+}
+
+static void
+__vec_os_release(
+    void *addr,
+    size_t size)
+{
+  munmap(addr, size);
+}
+#endif
+#endif
+
+/*
+ * Read-only view of a whole file with private (copy-on-write) pages.
+ */
+#if defined(_WIN32)
+#define __VEC_MAP_SUPPORTED
+
+static void *
+__vec_os_map_file(
+    const char *path,
+    int flags,
+    size_t *size)
+{
+  (void)flags;
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+      (flags & VEC_MAP_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+
+  LARGE_INTEGER file_size;
+  void *addr = NULL;
+  if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(mapping) {
+      addr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+    *size = (size_t)file_size.QuadPart;
+  }
+  CloseHandle(file);
+  return addr;
+}
+
+static void
+__vec_os_unmap_file(
+    void *addr,
+    size_t size)
+{
+  (void)size;
+  UnmapViewOfFile(addr);
+}
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#define __VEC_MAP_SUPPORTED
+
+static void *
+__vec_os_map_file(
+    const char *path,
+    int flags,
+    size_t *size)
+{
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  void *addr = NULL;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    int map_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if(flags & VEC_MAP_POPULATE) {
+      map_flags |= MAP_POPULATE;
+    }
+#endif
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, map_flags, fd, 0);
+    if(addr == MAP_FAILED) {
+      addr = NULL;
+    }
+#ifdef MADV_SEQUENTIAL
+    else if(flags & VEC_MAP_SEQUENTIAL) {
+      (void)madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    }
+#endif
+    *size = (size_t)st.st_size;
+  }
+  close(fd);
+  (void)flags;
+  return addr;
+}
+
+static void
+__vec_os_unmap_file(
+    void *addr,
+    size_t size)
+{
+  munmap(addr, size);
+}
+#endif
+
+#define __VEC_FILE_MAGIC "VECFILE"
+#define __VEC_FILE_VERSION 1
+#define __VEC_FILE_BOM 0x01020304u
+
+/*
+ * Header at the start of files written by `vec_save()`. It is followed by
+ * room for a `struct vec_meta_t` that is filled in when the file is mapped,
+ * so that the elements can be used in place.
+ */
+struct __vec_file_header {
+  char magic[8];
+  //! `__VEC_FILE_BOM` in the byte order of the machine that saved the file.
+  uint32_t bom;
+  uint32_t version;
+  uint64_t elemsize;
+  uint64_t length;
+  //! Distance (in bytes) between the start of the file and the first element.
+  uint64_t data_offset;
+};
+
+//! Distance (in bytes) between the start of a saved file and its first element.
+#define __VEC_FILE_DATA_OFFSET \
+  ((sizeof(struct __vec_file_header) + sizeof(struct vec_meta_t) + (VEC_CACHE_LINE - 1)) & ~(size_t)(VEC_CACHE_LINE - 1))
+
+struct __vec_reservation {
+  //! Size (in bytes) of the whole address range.
+  size_t reserved;
+  //! Bytes at the start of the range that are readable and writable.
+  size_t committed;
+  //! Page size that commits are rounded to.
+  size_t granularity;
+};
+
+//! Size (in bytes) of the file that a `VEC_ALLOCATION_TYPE_MAPPED` vector maps.
+#define __vec_mapped_size(metadata) \
+  ((metadata)->offset + ((metadata)->capacity * (metadata)->elemsize))
+
+#define __vec_reservation_of(metadata) \
+  ((struct __vec_reservation *)((char *)((metadata) + 1) - (metadata)->offset))
+
+#ifdef __VEC_RESERVE_SUPPORTED
+/*
+ * Commits the pages that are needed for `cap` elements and decommits the ones
+ * after them.
+ */
+static vec_error_t
+__vec_reserved_commit(
+    struct vec_meta_t *metadata,
+    size_t cap)
+{
+  struct __vec_reservation *r = __vec_reservation_of(metadata);
+  size_t max_cap = metadata->elemsize ? (r->reserved - metadata->offset) / metadata->elemsize : SIZE_MAX;
+  if(cap > max_cap) {
+    return VEC_ERR_OOM;
+  }
+
+  size_t needed = metadata->offset + (cap * metadata->elemsize);
+  needed = (needed + (r->granularity - 1)) & ~(r->granularity - 1);
+  if(needed > r->reserved) {
+    needed = r->reserved;
+  }
+
+  if(needed > r->committed) {
+    if(!__vec_os_commit((char *)r + r->committed, needed - r->committed)) {
+      return VEC_ERR_OOM;
+    }
+  } else if(needed < r->committed) {
+    __vec_os_decommit((char *)r + needed, r->committed - needed);
+  }
+  r->committed = needed;
+  return VEC_ERR_NONE;
+}
+#endif
+
+static void *
+__vec_default_alloc(
+    void *ctx,
+    size_t size)
+{
+  (void)ctx;
+  return malloc(size);
+}
+
+static void *
+__vec_default_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old_size,
+    size_t new_size)
+{
+  (void)ctx;
+  (void)old_size;
+  return realloc(ptr, new_size);
+}
+
+static void
+__vec_default_free(
+    void *ctx,
+    void *ptr,
+    size_t size)
+{
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+static const vec_allocator_t __vec_malloc_allocator = {
+  .alloc_fn   = __vec_default_alloc,
+  .realloc_fn = __vec_default_realloc,
+  .free_fn    = __vec_default_free,
+  .ctx        = NULL,
+};
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define __vec_thread_local __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define __vec_thread_local _Thread_local
+#else
+#define __vec_thread_local __thread
+#endif
+
+// A free block of the pool allocator; the link lives in the block itself.
+struct __vec_class_block {
+  struct __vec_class_block *next;
+};
+
+// Free blocks of one size class that belong to a single thread.
+struct __vec_class_cache {
+  struct __vec_class_block *head;
+  size_t count;
+};
+
+static __vec_thread_local struct __vec_class_cache __vec_class_caches[VEC_POOL_CLASSES];
+
+/*
+ * Global free lists, one per class. Blocks are only pushed as whole chains
+ * and only taken as a whole list, which keeps the list free of ABA issues.
+ */
+static struct {
+  __vec_align(VEC_CACHE_LINE) void *head;
+} __vec_class_spill[VEC_POOL_CLASSES];
+
+// Size class of a `size` bytes block, or -1 if it is too large to be pooled.
+static int
+__vec_class_of(
+    size_t size)
+{
+  size_t block = VEC_POOL_MIN_BLOCK;
+  for(int c = 0; c < VEC_POOL_CLASSES; c++, block <<= 1) {
+    if(size <= block) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+// Pushes the chain `first`..`last` onto the global list of class `c`.
+static void
+__vec_class_spill_chain(
+    int c,
+    struct __vec_class_block *first,
+    struct __vec_class_block *last)
+{
+  void *head = __vec_atomic_load_ptr(&__vec_class_spill[c].head, __VEC_RELAXED);
+  for(;;) {
+    last->next = (struct __vec_class_block *)head;
+    if(__vec_atomic_cas_ptr(&__vec_class_spill[c].head, head, first, __VEC_RELEASE)) {
+      return;
+    }
+    head = __vec_atomic_load_ptr(&__vec_class_spill[c].head, __VEC_RELAXED);
+  }
+}
+
+static void *
+__vec_class_alloc(
+    void *ctx,
+    size_t size)
+{
+  (void)ctx;
+  int c = __vec_class_of(size);
+  if(c < 0) {
+    return malloc(size);
+  }
+
+  struct __vec_class_cache *cache = &__vec_class_caches[c];
+  if(!cache->head) {
+    cache->head = (struct __vec_class_block *)__vec_atomic_exchange_ptr(&__vec_class_spill[c].head, NULL, __VEC_ACQUIRE);
+    cache->count = 0;
+    for(struct __vec_class_block *b = cache->head; b; b = b->next) {
+      cache->count++;
+    }
+    if(!cache->head) {
+      return malloc((size_t)VEC_POOL_MIN_BLOCK << c);
+    }
+  }
+
+  struct __vec_class_block *b = cache->head;
+  cache->head = b->next;
+  cache->count--;
+  return b;
+}
+
+static void
+__vec_class_free(
+    void *ctx,
+    void *ptr,
+    size_t size)
+{
+  (void)ctx;
+  int c = __vec_class_of(size);
+  if(c < 0) {
+    free(ptr);
+    return;
+  }
+
+  struct __vec_class_cache *cache = &__vec_class_caches[c];
+  struct __vec_class_block *b = (struct __vec_class_block *)ptr;
+  b->next = cache->head;
+  cache->head = b;
+  if(++cache->count > VEC_POOL_CACHE_MAX) {
+    // Keep the most recently freed (warmest) half, spill the rest.
+    struct __vec_class_block *keep = cache->head;
+    for(size_t i = 1; i < VEC_POOL_CACHE_MAX / 2; i++) {
+      keep = keep->next;
+    }
+    struct __vec_class_block *first = keep->next, *last = first;
+    while(last->next) {
+      last = last->next;
+    }
+    keep->next = NULL;
+    cache->count = VEC_POOL_CACHE_MAX / 2;
+    __vec_class_spill_chain(c, first, last);
+  }
+}
+
+static void *
+__vec_class_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old_size,
+    size_t new_size)
+{
+  int old_class = __vec_class_of(old_size);
+  int new_class = __vec_class_of(new_size);
+  if(old_class == new_class) {
+    return old_class < 0 ? realloc(ptr, new_size) : ptr;
+  }
+
+  void *fresh = __vec_class_alloc(ctx, new_size);
+  if(!fresh) {
+    return NULL;
+  }
+  memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+  __vec_class_free(ctx, ptr, old_size);
+  return fresh;
+}
+
+static const vec_allocator_t __vec_class_allocator = {
+  .alloc_fn   = __vec_class_alloc,
+  .realloc_fn = __vec_class_realloc,
+  .free_fn    = __vec_class_free,
+  .ctx        = NULL,
+};
+
+const vec_allocator_t *
+vec_pool_allocator(void)
+{
+  return &__vec_class_allocator;
+}
+
+void
+vec_pool_flush(void)
+{
+  for(int c = 0; c < VEC_POOL_CLASSES; c++) {
+    struct __vec_class_cache *cache = &__vec_class_caches[c];
+    if(cache->head) {
+      struct __vec_class_block *last = cache->head;
+      while(last->next) {
+        last = last->next;
+      }
+      __vec_class_spill_chain(c, cache->head, last);
+      cache->head  = NULL;
+      cache->count = 0;
+    }
+  }
+}
+
+void
+vec_pool_trim(void)
+{
+  vec_pool_flush();
+  for(int c = 0; c < VEC_POOL_CLASSES; c++) {
+    struct __vec_class_block *b = (struct __vec_class_block *)__vec_atomic_exchange_ptr(&__vec_class_spill[c].head, NULL, __VEC_ACQUIRE);
+    while(b) {
+      struct __vec_class_block *next = b->next;
+      free(b);
+      b = next;
+    }
+  }
+}
+
+#ifdef VEC_POOL_DEFAULT
+static const vec_allocator_t *__vec_default_allocator = &__vec_class_allocator;
+#else
+static const vec_allocator_t *__vec_default_allocator = &__vec_malloc_allocator;
+#endif
+
+// Allocator of the vector with the metadata `m`, or the default one if it has none.
+#define __vec_allocator_of(m) \
+  (__vec_meta_allocator(m) ? __vec_meta_allocator(m) : __vec_default_allocator)
+
+void
+vec_set_default_allocator(
+    const vec_allocator_t *allocator)
+{
+  __vec_default_allocator = allocator ? allocator : &__vec_malloc_allocator;
+}
+
+const vec_allocator_t *
+vec_get_default_allocator(void)
+{
+  return __vec_default_allocator;
+}
+
+static void *
+__vec_arena_alloc(
+    void *ctx,
+    size_t size)
+{
+  vec_arena_t *arena = (vec_arena_t *)ctx;
+
+  uintptr_t base  = (uintptr_t)arena->buffer;
+  uintptr_t start = (base + arena->offset + (VEC_ARENA_ALIGN - 1)) & ~(uintptr_t)(VEC_ARENA_ALIGN - 1);
+  size_t offset   = (size_t)(start - base);
+
+  if (offset > arena->size || size > arena->size - offset) {
+    return NULL;
+  }
+
+  arena->last   = arena->buffer + offset;
+  arena->offset = offset + size;
+  return arena->last;
+}
+
+static void *
+__vec_arena_realloc(
+    void *ctx,
+    void *ptr,
+    size_t old_size,
+    size_t new_size)
+{
+  vec_arena_t *arena = (vec_arena_t *)ctx;
+
+  if ((char *)ptr == arena->last) {
+    size_t offset = (size_t)(arena->last - arena->buffer);
+    if (new_size > arena->size - offset) {
+      return NULL;
+    }
+    arena->offset = offset + new_size;
+    return ptr;
+  }
+
+  if (new_size <= old_size) {
+    return ptr;
+  }
+
+  void *tmp = __vec_arena_alloc(ctx, new_size);
+  if (!tmp) {
+    return NULL;
+  }
+  memcpy(tmp, ptr, old_size);
+  return tmp;
+}
+
+static void
+__vec_arena_free(
+    void *ctx,
+    void *ptr,
+    size_t size)
+{
+  vec_arena_t *arena = (vec_arena_t *)ctx;
+  (void)size;
+
+  if ((char *)ptr == arena->last) {
+    arena->offset = (size_t)(arena->last - arena->buffer);
+    arena->last   = NULL;
+  }
+}
+
+vec_error_t
+vec_arena_init(
+    vec_arena_t *arena,
+    void *buffer,
+    size_t size)
+{
+  const vec_allocator_t *backing = NULL;
+  if (!buffer) {
+    // Kept so that the buffer is released with the same allocator even if the
+    // default one is changed before `vec_arena_fini()`.
+    backing = __vec_default_allocator;
+    buffer  = backing->alloc_fn(backing->ctx, size);
+    if (!buffer) {
+      return VEC_ERR_OOM;
+    }
+  }
+
+  *arena = (vec_arena_t){
+    .allocator = {
+      .alloc_fn   = __vec_arena_alloc,
+      .realloc_fn = __vec_arena_realloc,
+      .free_fn    = __vec_arena_free,
+      .ctx        = arena,
+    },
+    .buffer      = (char *)buffer,
+    .size        = size,
+    .offset      = 0,
+    .last        = NULL,
+    .backing     = backing,
+  };
+
+  return VEC_ERR_NONE;
+}
+
+void
+vec_arena_reset(
+    vec_arena_t *arena)
+{
+  arena->offset = 0;
+  arena->last   = NULL;
+}
+
+void
+vec_arena_fini(
+    vec_arena_t *arena)
+{
+  vec_arena_reset(arena);
+  if (arena->backing) {
+    arena->backing->free_fn(arena->backing->ctx, arena->buffer, arena->size);
+  }
+  arena->buffer  = NULL;
+  arena->backing = NULL;
+  arena->size   = 0;
+}
+
+const vec_allocator_t *
+vec_arena_allocator(
+    vec_arena_t *arena)
+{
+  return &arena->allocator;
+}
+
+vec_t
+vec_init_impl(
+    size_t elemsize, 
+    elem_copy copy, 
+    elem_destr destr)
+{
+  return vec_init_w_allocator_impl(elemsize, copy, destr, NULL);
+}
+
+vec_t
+vec_init_w_allocator_impl(
+    size_t elemsize, 
+    elem_copy copy, 
+    elem_destr destr,
+    const vec_allocator_t *allocator)
+{
+  return vec_init_aligned_impl(elemsize, 0, copy, destr, allocator);
+}
+
+static vec_t
+__vec_init_heap(
+    size_t elemsize, 
+    size_t alignment,
+    const vec_type_t *type,
+    int share)
+{
+  if (alignment & (alignment - 1))
+    return NULL;
+
+  if (elemsize > VEC_MAX_ELEMSIZE || alignment > VEC_MAX_ALIGNMENT)
+    return NULL;
+
+  vec_type_t resolved = *type;
+  if (!resolved.allocator) {
+    resolved.allocator = __vec_default_allocator;
+    share = 0;
+  }
+  const vec_allocator_t *allocator = resolved.allocator;
+
+  struct vec_meta_t layout = { .elemsize = elemsize, .alignment = alignment };
+  void *block = allocator->alloc_fn(allocator->ctx, __vec_block_size(&layout, VEC_INIT_CAP));
+  if (!block)
+    return NULL;
+
+  size_t offset = __vec_data_offset(block, alignment);
+  struct vec_meta_t *metadata = (struct vec_meta_t *)((char *)block + offset) - 1;
+  *metadata = (struct vec_meta_t){
+    .length   = 0,
+    .capacity = VEC_INIT_CAP,
+    .elemsize = elemsize,
+    .allocationType = VEC_ALLOCATION_TYPE_HEAP,
+    __VEC_META_MAGIC
+    .alignment = alignment,
+    .offset   = offset,
+  };
+  if (__vec_meta_set_type(metadata, share ? type : &resolved, share)) {
+    allocator->free_fn(allocator->ctx, block, __vec_block_size(&layout, VEC_INIT_CAP));
+    return NULL;
+  }
+
+  return metadata + 1;
+}
+
+vec_t
+vec_init_aligned_impl(
+    size_t elemsize, 
+    size_t alignment,
+    elem_copy copy, 
+    elem_destr destr,
+    const vec_allocator_t *allocator)
+{
+  vec_type_t type = { .copy_fn = copy, .destr_fn = destr, .allocator = allocator };
+  return __vec_init_heap(elemsize, alignment, &type, 0);
+}
+
+vec_t
+vec_init_w_type_impl(
+    size_t elemsize, 
+    const vec_type_t *type)
+{
+  return __vec_init_heap(elemsize, 0, type, 1);
+}
+
+void *
+vec_iter_begin(
+    vec_t v)
+{
+  return v;
+}
+
+void *
+vec_iter_end(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+
+  return ((char *)v) + (metadata->elemsize * metadata->length);
+}
+
+vec_t
+vec_init_w_storage_impl(
+    void *buffer,
+    size_t size,
+    size_t elemsize, 
+    elem_copy copy, 
+    elem_destr destr)
+{
+  size_t offset = __vec_data_offset(buffer, __VEC_MAX_ALIGN);
+  if (offset > size)
+    return NULL;
+
+  if (elemsize > VEC_MAX_ELEMSIZE)
+    return NULL;
+
+  size_t cap = elemsize ? (size - offset) / elemsize : 0;
+  struct vec_meta_t *metadata = (struct vec_meta_t *)((char *)buffer + offset) - 1;
+  *metadata = (struct vec_meta_t){
+    .length   = 0,
+    .capacity = cap < VEC_MAX_CAPACITY ? cap : VEC_MAX_CAPACITY,
+    .elemsize = elemsize,
+    .allocationType = VEC_ALLOCATION_TYPE_INLINE,
+    __VEC_META_MAGIC
+  };
+  vec_type_t type = { .copy_fn = copy, .destr_fn = destr };
+  if (__vec_meta_set_type(metadata, &type, 0))
+    return NULL;
+
+  return metadata + 1;
+}
+
+vec_t
+vec_init_reserved_impl(
+    size_t elemsize,
+    size_t max_capacity,
+    int flags,
+    elem_copy copy, 
+    elem_destr destr)
+{
+#ifdef __VEC_RESERVE_SUPPORTED
+  // Keep the header on a `__VEC_MAX_ALIGN` boundary after the bookkeeping.
+  size_t offset = ((sizeof(struct __vec_reservation) + (__VEC_MAX_ALIGN - 1)) & ~(size_t)(__VEC_MAX_ALIGN - 1)) +
+                  sizeof(struct vec_meta_t);
+  if(elemsize > VEC_MAX_ELEMSIZE || (elemsize && max_capacity > (SIZE_MAX - offset) / elemsize)) {
+    return NULL;
+  }
+  if(max_capacity > VEC_MAX_CAPACITY) {
+    max_capacity = VEC_MAX_CAPACITY;
+  }
+
+  size_t reserved = offset + (max_capacity * elemsize);
+  size_t granularity;
+  void *block = __vec_os_reserve(&reserved, flags, &granularity);
+  if(!block) {
+    return NULL;
+  }
+
+  size_t cap = max_capacity < VEC_INIT_CAP ? max_capacity : VEC_INIT_CAP;
+  size_t committed = (offset + (cap * elemsize) + (granularity - 1)) & ~(granularity - 1);
+  if(!__vec_os_commit(block, committed)) {
+    __vec_os_release(block, reserved);
+    return NULL;
+  }
+
+  *(struct __vec_reservation *)block = (struct __vec_reservation){
+    .reserved    = reserved,
+    .committed   = committed,
+    .granularity = granularity,
+  };
+
+  struct vec_meta_t *metadata = (struct vec_meta_t *)((char *)block + offset) - 1;
+  *metadata = (struct vec_meta_t){
+    .length   = 0,
+    .capacity = cap,
+    .elemsize = elemsize,
+    .allocationType = VEC_ALLOCATION_TYPE_RESERVED,
+    __VEC_META_MAGIC
+    .offset   = offset,
+  };
+  vec_type_t type = { .copy_fn = copy, .destr_fn = destr };
+  if(__vec_meta_set_type(metadata, &type, 0)) {
+    __vec_os_release(block, reserved);
+    return NULL;
+  }
+
+  return metadata + 1;
+#else
+  (void)elemsize;
+  (void)max_capacity;
+  (void)flags;
+  (void)copy;
+  (void)destr;
+  return NULL;
+#endif
+}
+
+vec_t
+vec_map_file_impl(
+    const char *path,
+    size_t elemsize,
+    int flags)
+{
+#ifdef __VEC_MAP_SUPPORTED
+  size_t size = 0;
+  char *base = (char *)__vec_os_map_file(path, flags, &size);
+  if(!base) {
+    return NULL;
+  }
+
+  struct __vec_file_header hdr;
+  int valid = size >= sizeof(hdr);
+  if(valid) {
+    memcpy(&hdr, base, sizeof(hdr));
+    valid = !memcmp(hdr.magic, __VEC_FILE_MAGIC, sizeof(__VEC_FILE_MAGIC)) &&
+            hdr.bom == __VEC_FILE_BOM &&
+            hdr.version == __VEC_FILE_VERSION &&
+            hdr.elemsize == elemsize &&
+            elemsize <= VEC_MAX_ELEMSIZE &&
+            hdr.data_offset >= sizeof(hdr) + sizeof(struct vec_meta_t) &&
+            // `vec_save()` always starts the data on a cache line, which keeps
+            // both the header and the elements aligned.
+            hdr.data_offset % VEC_CACHE_LINE == 0 &&
+            // The offset must fit in `struct vec_meta_t`, or `vec_fini()`
+            // would unmap the wrong address.
+            hdr.data_offset <= VEC_MAX_OFFSET &&
+            hdr.data_offset <= size &&
+            (!elemsize || hdr.length <= (size - hdr.data_offset) / elemsize) &&
+            (!elemsize || (size - hdr.data_offset) / elemsize <= VEC_MAX_CAPACITY);
+  }
+  if(!valid) {
+    __vec_os_unmap_file(base, size);
+    return NULL;
+  }
+
+  struct vec_meta_t *metadata = (struct vec_meta_t *)(base + hdr.data_offset) - 1;
+  *metadata = (struct vec_meta_t){
+    .length   = (size_t)hdr.length,
+    .capacity = elemsize ? (size - (size_t)hdr.data_offset) / elemsize : (size_t)hdr.length,
+    .elemsize = elemsize,
+    .allocationType = VEC_ALLOCATION_TYPE_MAPPED,
+    __VEC_META_MAGIC
+    .offset   = (size_t)hdr.data_offset,
+  };
+
+  return metadata + 1;
+#else
+  (void)path;
+  (void)elemsize;
+  (void)flags;
+  return NULL;
+#endif
+}
+
+vec_error_t
+vec_save(
+    vec_t v,
+    const char *path)
+{
+  __GET_METADATA__(v)
+
+  // Header and the room for the in-memory metadata, written in one go.
+  char head[__VEC_FILE_DATA_OFFSET] = { 0 };
+  size_t data_offset = sizeof(head);
+  struct __vec_file_header hdr = {
+    .magic       = __VEC_FILE_MAGIC,
+    .bom         = __VEC_FILE_BOM,
+    .version     = __VEC_FILE_VERSION,
+    .elemsize    = metadata->elemsize,
+    .length      = metadata->length,
+    .data_offset = data_offset,
+  };
+  memcpy(head, &hdr, sizeof(hdr));
+
+  FILE *file = fopen(path, "wb");
+  if(!file) {
+    return VEC_ERR_IO;
+  }
+
+  size_t bytes = metadata->length * metadata->elemsize;
+  int ok = fwrite(head, 1, data_offset, file) == data_offset &&
+           (!bytes || fwrite(v, 1, bytes, file) == bytes);
+  ok = (fclose(file) == 0) && ok;
+
+  return ok ? VEC_ERR_NONE : VEC_ERR_IO;
+}
+
+void
+vec_iter_next(
+    vec_t v, 
+    void **iter)
+{
+  __GET_METADATA__(v)
+  *iter = ((char*)*iter) + metadata->elemsize;
+}
+
+void
+vec_fini(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+
+  // Only the last owner of a shared buffer destroys it.
+  if(__vec_is_shared(metadata) &&
+     __vec_atomic_fetch_add32(&metadata->shared, (uint32_t)-1, __VEC_SEQ_CST) != 0) {
+    return;
+  }
+
+  if (__vec_meta_destr_fn(metadata)) {
+    for (void *elem = vec_iter_begin(v); elem != vec_iter_end(v);
+         vec_iter_next(v, &elem)) {
+      __vec_meta_destr_fn(metadata)(elem);
+    }
+  }
+  API_CHECK(__vec_check_poison(metadata, 0, metadata->length));
+  API_CHECK(metadata->magic = __VEC_MAGIC_DEAD);
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_HEAP) {
+    __vec_meta_allocator(metadata)->free_fn(__vec_meta_allocator(metadata)->ctx, (char *)v - metadata->offset,
+        __vec_block_size(metadata, metadata->capacity));
+  }
+#ifdef __VEC_RESERVE_SUPPORTED
+  else if(metadata->allocationType == VEC_ALLOCATION_TYPE_RESERVED) {
+    struct __vec_reservation *r = __vec_reservation_of(metadata);
+    __vec_os_release(r, r->reserved);
+  }
+#endif
+#ifdef __VEC_MAP_SUPPORTED
+  else if(metadata->allocationType == VEC_ALLOCATION_TYPE_MAPPED) {
+    __vec_os_unmap_file((char *)v - metadata->offset, __vec_mapped_size(metadata));
+  }
+#endif
+}
+
+int
+vec_push(
+    vec_t *v, 
+    void *val)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if (metadata->length == metadata->capacity) {
+    vec_error_t grow_err = vec_grow(v);
+    if(grow_err) {
+      return grow_err;
+    } else {
+      __SYNC_METADATA__(*v)
+    }
+  }
+
+  void *dst = ((char *)*v) + (metadata->length * metadata->elemsize);
+  if (__vec_meta_copy_fn(metadata)) {
+    __vec_meta_copy_fn(metadata)(dst, val);
+  } else {
+    memcpy(dst, val, metadata->elemsize);
+  }
+
+  __VEC_STATS_PUSH(metadata, 1);
+  return (int)metadata->length++;
+}
+
+int
+vec_append(
+    vec_t *v,
+    const void *arr,
+    size_t size)
+{
+  __GET_METADATA__(*v)
+  size_t old_len = metadata->length;
+  size_t req_len = old_len + size;
+
+  vec_error_t setlen_err = vec_setlen(v, req_len);
+  if(setlen_err) {
+    return setlen_err;
+  }
+  __SYNC_METADATA__(*v)
+
+  void *dst = ((char *)*v) + (old_len * metadata->elemsize);
+  memcpy(dst, arr, metadata->elemsize * size);
+
+#ifdef VEC_STATS
+  metadata->stats.pushes += size;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, size, __VEC_RELAXED);
+#endif
+
+  return (int)old_len;
+}
+
+/*
+ * Copies `n` elements into uninitialized slots of the vector, preferring the
+ * range copy function, then the element copy function, then memcpy.
+ */
+static void
+__vec_copy_range(
+    struct vec_meta_t *metadata,
+    void *dst,
+    const void *src,
+    size_t n)
+{
+  if (__vec_meta_copy_n_fn(metadata)) {
+    __vec_meta_copy_n_fn(metadata)(dst, src, n);
+  } else if (__vec_meta_copy_fn(metadata)) {
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    for (size_t i = 0; i < n; i++) {
+      __vec_meta_copy_fn(metadata)(d, s);
+      d += metadata->elemsize;
+      s += metadata->elemsize;
+    }
+  } else {
+    memcpy(dst, src, metadata->elemsize * n);
+  }
+}
+
+int
+vec_append_copy(
+    vec_t *v,
+    const void *arr,
+    size_t size)
+{
+  __GET_METADATA__(*v)
+  size_t old_len = metadata->length;
+  size_t req_len = old_len + size;
+
+  vec_error_t setlen_err = vec_setlen(v, req_len);
+  if(setlen_err) {
+    return setlen_err;
+  }
+  __SYNC_METADATA__(*v)
+
+  void *dst = ((char *)*v) + (old_len * metadata->elemsize);
+  __vec_copy_range(metadata, dst, arr, size);
+
+#ifdef VEC_STATS
+  metadata->stats.pushes += size;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, size, __VEC_RELAXED);
+#endif
+
+  return (int)old_len;
+}
+
+vec_error_t
+vec_set_copy_n(
+    vec_t *v,
+    elem_copy_n copy_n)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  vec_type_t type = __vec_meta_type(metadata);
+  type.copy_n_fn = copy_n;
+  return __vec_meta_set_type(metadata, &type, 0);
+}
+
+void *
+vec_emplace_back(
+    vec_t *v)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, NULL)
+
+  if (metadata->length == metadata->capacity) {
+    if(vec_grow(v)) {
+      return NULL;
+    }
+    __SYNC_METADATA__(*v)
+  }
+
+  __VEC_STATS_PUSH(metadata, 1);
+  return ((char *)*v) + (metadata->length++ * metadata->elemsize);
+}
+
+void *
+vec_emplace_n(
+    vec_t *v,
+    size_t n)
+{
+  __GET_METADATA__(*v)
+  size_t old_len = metadata->length;
+
+  if(vec_setlen(v, old_len + n)) {
+    return NULL;
+  }
+  __SYNC_METADATA__(*v)
+
+#ifdef VEC_STATS
+  metadata->stats.pushes += n;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, n, __VEC_RELAXED);
+#endif
+
+  return ((char *)*v) + (old_len * metadata->elemsize);
+}
+
+vec_error_t
+vec_set_move(
+    vec_t *v,
+    elem_move move)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  vec_type_t type = __vec_meta_type(metadata);
+  type.move_fn = move;
+  return __vec_meta_set_type(metadata, &type, 0);
+}
+
+int
+vec_push_move(
+    vec_t *v,
+    void *val)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if (metadata->length == metadata->capacity) {
+    vec_error_t grow_err = vec_grow(v);
+    if(grow_err) {
+      return grow_err;
+    } else {
+      __SYNC_METADATA__(*v)
+    }
+  }
+
+  void *dst = ((char *)*v) + (metadata->length * metadata->elemsize);
+  __vec_relocate(metadata, dst, val, 1);
+
+  __VEC_STATS_PUSH(metadata, 1);
+  return (int)metadata->length++;
+}
+
+vec_error_t
+vec_pop_move(
+    vec_t *v,
+    void *out)
+{
+  __GET_METADATA__(*v)
+  if(!metadata->length) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  void *src = ((char *)*v) + ((metadata->length-1) * metadata->elemsize);
+  __vec_relocate(metadata, out, src, 1);
+
+  metadata->length--;
+  API_CHECK(__vec_check_poison(metadata, metadata->length, 1));
+  __vec_maybe_shrink(v);
+
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_pop(
+    vec_t *v, 
+    void *out)
+{
+  __GET_METADATA__(*v)
+  if(!metadata->length) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if(out != NULL) {
+    void *src = ((char *)*v) + ((metadata->length-1) * metadata->elemsize);
+    if (__vec_meta_copy_fn(metadata)) {
+      __vec_meta_copy_fn(metadata)(out, src);
+    } else {
+      memcpy(out, src, metadata->elemsize);
+    }
+  } else {
+    void *elem = ((char *)*v) + ((metadata->length-1) * metadata->elemsize);
+    if (__vec_meta_destr_fn(metadata)) {
+      __vec_meta_destr_fn(metadata)(elem);
+    }
+  }
+
+  metadata->length--;
+  API_CHECK(__vec_check_poison(metadata, metadata->length, 1));
+  __vec_maybe_shrink(v);
+
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_swap_remove(
+    vec_t *v,
+    size_t idx)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if(idx >= metadata->length) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  char *elem = ((char *)*v) + (idx * metadata->elemsize);
+  if (__vec_meta_destr_fn(metadata)) {
+    __vec_meta_destr_fn(metadata)(elem);
+  }
+
+  size_t last = metadata->length - 1;
+  if(idx != last) {
+    __vec_relocate(metadata, elem, ((char *)*v) + (last * metadata->elemsize), 1);
+  }
+
+  metadata->length--;
+  API_CHECK(__vec_check_poison(metadata, last, 1));
+  __vec_maybe_shrink(v);
+
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_erase_range(
+    vec_t *v,
+    size_t first,
+    size_t count)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if(first > metadata->length || count > metadata->length - first) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  char *begin = ((char *)*v) + (first * metadata->elemsize);
+  char *end   = begin + (count * metadata->elemsize);
+  if (__vec_meta_destr_fn(metadata)) {
+    for (char *elem = begin; elem != end; elem += metadata->elemsize) {
+      __vec_meta_destr_fn(metadata)(elem);
+    }
+  }
+
+  __vec_relocate(metadata, begin, end, metadata->length - first - count);
+
+  metadata->length -= count;
+  API_CHECK(__vec_check_poison(metadata, metadata->length, count));
+  __vec_maybe_shrink(v);
+
+  return VEC_ERR_NONE;
+}
+
+/*
+ * Opens a gap of `count` uninitialized slots at `idx`, growing the vector if
+ * needed. Returns a pointer to the first slot, or NULL on OOM.
+ */
+static void *
+__vec_open_gap(
+    vec_t *v,
+    size_t idx,
+    size_t count)
+{
+  __GET_METADATA__(*v)
+  size_t old_len = metadata->length;
+
+  if(vec_setlen(v, old_len + count)) {
+    return NULL;
+  }
+  __SYNC_METADATA__(*v)
+
+  char *gap = ((char *)*v) + (idx * metadata->elemsize);
+  __vec_relocate(metadata, gap + (count * metadata->elemsize), gap, old_len - idx);
+
+  return gap;
+}
+
+int
+vec_insert(
+    vec_t *v,
+    size_t idx,
+    const void *val)
+{
+  return vec_insert_range(v, idx, val, 1);
+}
+
+int
+vec_insert_range(
+    vec_t *v,
+    size_t idx,
+    const void *arr,
+    size_t count)
+{
+  __GET_METADATA__(*v)
+
+  if(idx > metadata->length) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  void *gap = __vec_open_gap(v, idx, count);
+  if(!gap) {
+    return VEC_ERR_OOM;
+  }
+  __SYNC_METADATA__(*v)
+
+  __vec_copy_range(metadata, gap, arr, count);
+
+#ifdef VEC_STATS
+  metadata->stats.pushes += count;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, count, __VEC_RELAXED);
+#endif
+
+  return (int)idx;
+}
+
+void *
+vec_last(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+
+  if(metadata->length == 0) {
+    return NULL;
+  }
+
+  return ((char *)v) + ((metadata->length-1) * metadata->elemsize);
+}
+
+size_t
+vec_len(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+  return metadata->length;
+}
+
+size_t
+vec_capacity(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+  return metadata->capacity;
+}
+
+int
+vec_clear(
+    vec_t v)
+{
+  __GET_METADATA__(v)
+
+  if(__vec_is_shared(metadata)) {
+    return VEC_ERR_SHARED;
+  }
+
+  if (__vec_meta_destr_fn(metadata)) {
+    for (void *elem = vec_iter_begin(v); elem != vec_iter_end(v);
+         vec_iter_next(v, &elem)) {
+      __vec_meta_destr_fn(metadata)(elem);
+    }
+  }
+
+  API_CHECK(__vec_check_poison(metadata, 0, metadata->length));
+  metadata->length = 0;
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_clear_unshare(
+    vec_t *v)
+{
+  __GET_METADATA__(*v)
+
+  if(vec_clear(*v) != VEC_ERR_SHARED) {
+    return VEC_ERR_NONE;
+  }
+
+  // Copying elements only to destroy them is pointless; start over with an
+  // empty buffer and leave the elements to the other handles.
+  vec_type_t type = __vec_meta_type(metadata);
+  vec_t empty = __vec_init_heap(metadata->elemsize, metadata->alignment, &type, 0);
+  if(!empty) {
+    return VEC_ERR_OOM;
+  }
+  __vec_hdr(empty)->shrink_policy = metadata->shrink_policy;
+  vec_fini(*v);
+  *v = empty;
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_setlen(
+    vec_t *v, 
+    size_t len)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if(len > metadata->capacity) {
+    vec_error_t grow_err = vec_setcapacity(v, __vec_next_capacity(metadata->capacity, len));
+    if(grow_err) {
+      return grow_err;
+    }
+    __SYNC_METADATA__(*v)
+  }
+
+#ifdef VEC_STATS
+  __vec_stats_length(metadata, len);
+#endif
+  if(len < metadata->length) {
+    API_CHECK(__vec_check_poison(metadata, len, metadata->length - len));
+    metadata->length = len;
+    __vec_maybe_shrink(v);
+  } else {
+    metadata->length = len;
+  }
+  return VEC_ERR_NONE;
+}
+
+/*
+ * Moves the vector to a new heap block with a capacity of `cap`, relocating
+ * its elements one by one. This is used instead of the allocator's realloc
+ * when the vector does not own its current storage (see
+ * `VEC_ALLOCATION_TYPE_INLINE` and `VEC_ALLOCATION_TYPE_MAPPED`), or when its
+ * elements need a move function.
+ */
+static vec_error_t
+__vec_move_to_block(
+    vec_t *v,
+    size_t cap)
+{
+  __GET_METADATA__(*v)
+
+  const vec_allocator_t *allocator = __vec_allocator_of(metadata);
+  void *block = allocator->alloc_fn(allocator->ctx, __vec_block_size(metadata, cap));
+  if(!block) {
+    return VEC_ERR_OOM;
+  }
+
+#ifdef VEC_STATS
+  size_t old_cap = metadata->capacity;
+#endif
+  size_t len     = metadata->length < cap ? metadata->length : cap;
+  size_t offset  = __vec_data_offset(block, metadata->alignment);
+  struct vec_meta_t *heap_meta = (struct vec_meta_t *)((char *)block + offset) - 1;
+  *heap_meta = *metadata;
+  heap_meta->shared = 0;
+  if(__vec_meta_allocator(metadata) != allocator) {
+    vec_type_t type = __vec_meta_type(metadata);
+    type.allocator = allocator;
+    if(__vec_meta_set_type(heap_meta, &type, 0)) {
+      allocator->free_fn(allocator->ctx, block, __vec_block_size(metadata, cap));
+      return VEC_ERR_OOM;
+    }
+  }
+  __vec_relocate(metadata, heap_meta + 1, *v, len);
+
+  // Copies of the old handle must not keep using the inline storage.
+  API_CHECK(metadata->magic = __VEC_MAGIC_DEAD);
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_HEAP) {
+    __vec_meta_allocator(metadata)->free_fn(__vec_meta_allocator(metadata)->ctx, (char *)*v - metadata->offset,
+        __vec_block_size(metadata, metadata->capacity));
+  }
+#ifdef __VEC_MAP_SUPPORTED
+  else if(metadata->allocationType == VEC_ALLOCATION_TYPE_MAPPED) {
+    __vec_os_unmap_file((char *)*v - metadata->offset, __vec_mapped_size(metadata));
+  }
+#endif
+
+  heap_meta->allocationType = VEC_ALLOCATION_TYPE_HEAP;
+  heap_meta->offset         = offset;
+  heap_meta->capacity       = cap;
+  heap_meta->length         = len;
+  *v = heap_meta + 1;
+
+#ifdef VEC_STATS
+  __vec_stats_resize(heap_meta, old_cap, 1, len * heap_meta->elemsize);
+#endif
+
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_setcapacity(
+    vec_t *v, 
+    size_t cap)
+{
+  __GET_METADATA__(*v)
+
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_STACK) {
+    return VEC_ERR_OOM;
+  }
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  if(metadata->capacity == cap) {
+    return VEC_ERR_NONE;
+  }
+
+  if(cap > VEC_MAX_CAPACITY) {
+    return VEC_ERR_OOM;
+  }
+
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_INLINE ||
+     metadata->allocationType == VEC_ALLOCATION_TYPE_MAPPED) {
+    if(cap > metadata->capacity) {
+      return __vec_move_to_block(v, cap);
+    }
+    // The storage cannot shrink, only the length is truncated.
+    if(metadata->length > cap) {
+      API_CHECK(__vec_check_poison(metadata, cap, metadata->length - cap));
+      metadata->length = cap;
+    }
+    return VEC_ERR_NONE;
+  }
+
+#ifdef __VEC_RESERVE_SUPPORTED
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_RESERVED) {
+    // Pages are committed in place, the vector never moves.
+    vec_error_t err = __vec_reserved_commit(metadata, cap);
+    if(err) {
+      return err;
+    }
+#ifdef VEC_STATS
+    size_t old_cap = metadata->capacity;
+#endif
+    metadata->capacity = cap;
+    if(metadata->length > cap) {
+      metadata->length = cap;
+    }
+#ifdef VEC_STATS
+    __vec_stats_resize(metadata, old_cap, 0, 0);
+#endif
+    return VEC_ERR_NONE;
+  }
+#endif
+
+  if(__vec_meta_move_fn(metadata)) {
+    return __vec_move_to_block(v, cap);
+  }
+
+  size_t offset    = metadata->offset;
+  size_t alignment = metadata->alignment;
+  size_t len       = metadata->length < cap ? metadata->length : cap;
+  size_t elemsize  = metadata->elemsize;
+#ifdef VEC_STATS
+  size_t old_cap   = metadata->capacity;
+  size_t copied    = __vec_block_size(metadata, old_cap < cap ? old_cap : cap);
+#endif
+
+  void *buf = ((char *)(*v) - offset);
+  const vec_allocator_t *allocator = __vec_meta_allocator(metadata);
+  void *tmp = allocator->realloc_fn(allocator->ctx, buf,
+      __vec_block_size(metadata, metadata->capacity),
+      __vec_block_size(metadata, cap));
+
+  if (!tmp) {
+    return VEC_ERR_OOM;
+  }
+
+  if(buf != tmp) {
+    size_t new_offset = __vec_data_offset(tmp, alignment);
+    if(new_offset != offset) {
+      // The block moved to an address with a different alignment; shift the
+      // header and the live elements back onto the alignment boundary.
+      memmove((char *)tmp + new_offset - sizeof(struct vec_meta_t),
+              (char *)tmp + offset - sizeof(struct vec_meta_t),
+              sizeof(struct vec_meta_t) + (len * elemsize));
+    }
+    metadata = (struct vec_meta_t *)((char *)tmp + new_offset) - 1;
+    metadata->offset = new_offset;
+    *v = metadata + 1;
+  }
+
+  metadata->capacity = cap;
+  metadata->length   = len;
+#ifdef VEC_STATS
+  __vec_stats_resize(metadata, old_cap, buf != tmp, buf != tmp ? copied : 0);
+#endif
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_reserve(
+    vec_t *v,
+    size_t n)
+{
+  __GET_METADATA__(*v)
+
+  if(n <= metadata->capacity) {
+    return VEC_ERR_NONE;
+  }
+
+  return vec_setcapacity(v, n);
+}
+
+vec_error_t
+vec_shrink_to_fit(
+    vec_t *v)
+{
+  __GET_METADATA__(*v)
+
+  if(metadata->allocationType == VEC_ALLOCATION_TYPE_STACK) {
+    return VEC_ERR_NONE;
+  }
+
+  return vec_setcapacity(v, metadata->length ? metadata->length : 1);
+}
+
+vec_error_t
+vec_set_shrink_policy(
+    vec_t *v,
+    vec_shrink_policy_t policy)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  metadata->shrink_policy = policy;
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_grow(
+    vec_t *v)
+{
+  __GET_METADATA__(*v)
+  return vec_setcapacity(v, __vec_next_capacity(metadata->capacity, metadata->capacity + 1));
+}
+
+
+#ifdef VEC_PARALLEL
+#if defined(_WIN32)
+#include <windows.h>
+typedef HANDLE             __vec_thread_t;
+typedef SRWLOCK            __vec_mutex_t;
+typedef CONDITION_VARIABLE __vec_cond_t;
+#define __vec_mutex_lock(m)    AcquireSRWLockExclusive(m)
+#define __vec_mutex_trylock(m) TryAcquireSRWLockExclusive(m)
+#define __vec_mutex_unlock(m)  ReleaseSRWLockExclusive(m)
+#define __vec_cond_wait(c, m)  SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define __vec_cond_signal(c)   WakeConditionVariable(c)
+#define __vec_cond_broadcast(c) WakeAllConditionVariable(c)
+#define __VEC_MUTEX_INIT SRWLOCK_INIT
+#define __VEC_COND_INIT  CONDITION_VARIABLE_INIT
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t       __vec_thread_t;
+typedef pthread_mutex_t __vec_mutex_t;
+typedef pthread_cond_t  __vec_cond_t;
+#define __vec_mutex_lock(m)    pthread_mutex_lock(m)
+#define __vec_mutex_trylock(m) (pthread_mutex_trylock(m) == 0)
+#define __vec_mutex_unlock(m)  pthread_mutex_unlock(m)
+#define __vec_cond_wait(c, m)  pthread_cond_wait(c, m)
+#define __vec_cond_signal(c)   pthread_cond_signal(c)
+#define __vec_cond_broadcast(c) pthread_cond_broadcast(c)
+#define __VEC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define __VEC_COND_INIT  PTHREAD_COND_INITIALIZER
+#endif
+
+/*
+ * Built-in pool. A single batch of jobs is in flight at a time; the caller
+ * and every worker claim job indices from a shared counter until none are
+ * left, so faster threads naturally pick up the work of slower ones.
+ */
+static struct {
+  //! Serializes batches. Held by the thread that dispatched the current one.
+  __vec_mutex_t dispatch;
+  __vec_mutex_t lock;
+  __vec_cond_t wake;
+  __vec_cond_t done;
+
+  __vec_thread_t threads[VEC_PARALLEL_MAX_THREADS];
+  size_t nworkers;
+  int started;
+  int stop;
+
+  //! Incremented for every batch; workers wait for it to change.
+  size_t generation;
+  //! Number of workers that have not finished the current batch yet.
+  size_t busy;
+
+  void (*job)(void *data, size_t idx);
+  void *data;
+  size_t count;
+  size_t next;
+} __vec_pool = {
+  .dispatch = __VEC_MUTEX_INIT,
+  .lock     = __VEC_MUTEX_INIT,
+  .wake     = __VEC_COND_INIT,
+  .done     = __VEC_COND_INIT,
+};
+
+static void
+__vec_pool_drain(void)
+{
+  size_t idx;
+  while((idx = __vec_atomic_fetch_add(&__vec_pool.next, 1, __VEC_RELAXED)) < __vec_pool.count) {
+    __vec_pool.job(__vec_pool.data, idx);
+  }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI
+__vec_pool_worker(
+    LPVOID arg)
+#else
+static void *
+__vec_pool_worker(
+    void *arg)
+#endif
+{
+  // The generation at spawn time is passed in; reading it here would race
+  // with the first batch and leave this worker waiting on a batch it missed.
+  size_t seen = (size_t)(uintptr_t)arg;
+  __vec_mutex_lock(&__vec_pool.lock);
+  for(;;) {
+    while(!__vec_pool.stop && __vec_pool.generation == seen) {
+      __vec_cond_wait(&__vec_pool.wake, &__vec_pool.lock);
+    }
+    if(__vec_pool.stop) {
+      break;
+    }
+    seen = __vec_pool.generation;
+    __vec_mutex_unlock(&__vec_pool.lock);
+
+    __vec_pool_drain();
+
+    __vec_mutex_lock(&__vec_pool.lock);
+    if(--__vec_pool.busy == 0) {
+      __vec_cond_signal(&__vec_pool.done);
+    }
+  }
+  __vec_mutex_unlock(&__vec_pool.lock);
+  return 0;
+}
+
+static size_t
+__vec_pool_thread_count(void)
+{
+#if defined(VEC_PARALLEL_THREADS) && VEC_PARALLEL_THREADS > 0
+  size_t n = VEC_PARALLEL_THREADS;
+#elif defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size_t n = info.dwNumberOfProcessors;
+#else
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t n = online > 0 ? (size_t)online : 1;
+#endif
+  if(n > VEC_PARALLEL_MAX_THREADS) {
+    n = VEC_PARALLEL_MAX_THREADS;
+  }
+  return n ? n : 1;
+}
+
+// Must be called with `dispatch` held.
+static void
+__vec_pool_start(void)
+{
+  size_t n = __vec_pool_thread_count() - 1;
+  void *seen = (void *)(uintptr_t)__vec_pool.generation;
+  __vec_pool.stop = 0;
+  __vec_pool.nworkers = 0;
+  for(size_t i = 0; i < n; i++) {
+#if defined(_WIN32)
+    __vec_pool.threads[i] = CreateThread(NULL, 0, __vec_pool_worker, seen, 0, NULL);
+    if(!__vec_pool.threads[i]) {
+      break;
+    }
+#else
+    if(pthread_create(&__vec_pool.threads[i], NULL, __vec_pool_worker, seen)) {
+      break;
+    }
+#endif
+    __vec_pool.nworkers++;
+  }
+  __vec_pool.started = 1;
+}
+
+static void
+__vec_builtin_run(
+    void *ctx,
+    size_t count,
+    void (*job)(void *data, size_t idx),
+    void *data)
+{
+  (void)ctx;
+
+  // Nested or concurrent calls run on the calling thread instead of waiting.
+  if(!__vec_mutex_trylock(&__vec_pool.dispatch)) {
+    for(size_t i = 0; i < count; i++) {
+      job(data, i);
+    }
+    return;
+  }
+
+  if(!__vec_pool.started) {
+    __vec_pool_start();
+  }
+
+  __vec_mutex_lock(&__vec_pool.lock);
+  __vec_pool.job   = job;
+  __vec_pool.data  = data;
+  __vec_pool.count = count;
+  __vec_pool.next  = 0;
+  __vec_pool.busy  = __vec_pool.nworkers;
+  __vec_pool.generation++;
+  __vec_cond_broadcast(&__vec_pool.wake);
+  __vec_mutex_unlock(&__vec_pool.lock);
+
+  __vec_pool_drain();
+
+  __vec_mutex_lock(&__vec_pool.lock);
+  while(__vec_pool.busy) {
+    __vec_cond_wait(&__vec_pool.done, &__vec_pool.lock);
+  }
+  __vec_mutex_unlock(&__vec_pool.lock);
+
+  __vec_mutex_unlock(&__vec_pool.dispatch);
+}
+
+void
+vec_parallel_shutdown(void)
+{
+  __vec_mutex_lock(&__vec_pool.dispatch);
+  if(__vec_pool.started) {
+    __vec_mutex_lock(&__vec_pool.lock);
+    __vec_pool.stop = 1;
+    __vec_cond_broadcast(&__vec_pool.wake);
+    __vec_mutex_unlock(&__vec_pool.lock);
+    for(size_t i = 0; i < __vec_pool.nworkers; i++) {
+#if defined(_WIN32)
+      WaitForSingleObject(__vec_pool.threads[i], INFINITE);
+      CloseHandle(__vec_pool.threads[i]);
+#else
+      pthread_join(__vec_pool.threads[i], NULL);
+#endif
+    }
+    __vec_pool.nworkers = 0;
+    __vec_pool.started  = 0;
+  }
+  __vec_mutex_unlock(&__vec_pool.dispatch);
+}
+#else
+static void
+__vec_builtin_run(
+    void *ctx,
+    size_t count,
+    void (*job)(void *data, size_t idx),
+    void *data)
+{
+  (void)ctx;
+  for(size_t i = 0; i < count; i++) {
+    job(data, i);
+  }
+}
+
+void
+vec_parallel_shutdown(void)
+{
+}
+#endif
+
+static const vec_job_system_t __vec_builtin_jobs = {
+  .run_fn = __vec_builtin_run,
+  .ctx    = NULL,
+};
+
+static const vec_job_system_t *__vec_jobs = &__vec_builtin_jobs;
+
+void
+vec_set_job_system(
+    const vec_job_system_t *jobs)
+{
+  __vec_jobs = jobs ? jobs : &__vec_builtin_jobs;
+}
+
+struct __vec_parallel_task {
+  char *data;
+  size_t elemsize;
+  size_t length;
+  //! Number of elements processed by the first job.
+  size_t first;
+  size_t chunk;
+  vec_range_fn fn;
+  void *ctx;
+};
+
+static void
+__vec_parallel_job(
+    void *data,
+    size_t idx)
+{
+  struct __vec_parallel_task *task = (struct __vec_parallel_task *)data;
+
+  size_t begin = idx ? task->first + ((idx - 1) * task->chunk) : 0;
+  size_t end   = task->first + (idx * task->chunk);
+  if(end > task->length) {
+    end = task->length;
+  }
+
+  task->fn(task->data + (begin * task->elemsize), begin, end - begin, task->ctx);
+}
+
+void
+vec_parallel_for(
+    vec_t v,
+    vec_range_fn fn,
+    void *ctx,
+    size_t grain)
+{
+  __GET_METADATA__(v)
+
+  size_t length   = metadata->length;
+  size_t elemsize = metadata->elemsize;
+  if(length == 0) {
+    return;
+  }
+
+  // Smallest number of elements that spans a whole number of cache lines.
+  size_t a = elemsize, b = VEC_CACHE_LINE;
+  while(b) {
+    size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  size_t step = VEC_CACHE_LINE / a;
+
+  if(grain == 0) {
+    grain = 1;
+  }
+  size_t chunk = ((grain + step - 1) / step) * step;
+
+  // Elements before the first cache line boundary go to the first chunk,
+  // which lets every following chunk start on a boundary.
+  size_t misalign = (size_t)((uintptr_t)v % VEC_CACHE_LINE);
+  size_t gap      = misalign ? VEC_CACHE_LINE - misalign : 0;
+  size_t head     = (gap % elemsize == 0) ? gap / elemsize : 0;
+  if(head > length) {
+    head = length;
+  }
+
+  // Job 0 covers [0, head + chunk), job i > 0 covers the i-th chunk after it.
+  size_t first = head + chunk;
+  size_t rest  = length > first ? length - first : 0;
+  size_t njobs = 1 + ((rest + chunk - 1) / chunk);
+
+  struct __vec_parallel_task task = {
+    .data     = (char *)v,
+    .elemsize = elemsize,
+    .length   = length,
+    .first    = first,
+    .chunk    = chunk,
+    .fn       = fn,
+    .ctx      = ctx,
+  };
+
+  if(njobs == 1) {
+    fn(v, 0, length, ctx);
+    return;
+  }
+
+  __vec_jobs->run_fn(__vec_jobs->ctx, njobs, __vec_parallel_job, &task);
+}
+
+
+/*
+ * Index of the most significant set bit of `x`, which must not be 0.
+ */
+static size_t
+__vec_log2(
+    size_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long idx;
+#ifdef _WIN64
+  _BitScanReverse64(&idx, x);
+#else
+  _BitScanReverse(&idx, x);
+#endif
+  return idx;
+#else
+  return (sizeof(unsigned long long) * 8 - 1) - (size_t)__builtin_clzll((unsigned long long)x);
+#endif
+}
+
+//! Number of elements in segment `k` of a segmented vector.
+#define __vec_seg_size(k) ((size_t)1 << (VEC_SEG_BASE_LOG2 + (k)))
+
+/*
+ * Finds the segment `k` holding index `idx` and the index of the element
+ * inside that segment in O(1).
+ */
+static void
+__vec_seg_locate(
+    size_t idx,
+    size_t *k,
+    size_t *off)
+{
+  size_t j = idx + ((size_t)1 << VEC_SEG_BASE_LOG2);
+  size_t msb = __vec_log2(j);
+  *k   = msb - VEC_SEG_BASE_LOG2;
+  *off = j - ((size_t)1 << msb);
+}
+
+#if defined(_WIN32)
+#include <windows.h>
+#define __vec_yield() ((void)SwitchToThread())
+#else
+#include <sched.h>
+#define __vec_yield() ((void)sched_yield())
+#endif
+
+//! Value of `length` while `vec_concurrent_freeze()` runs.
+#define __VEC_CONCURRENT_CLOSED ((size_t)-1)
+
+// Size (in bytes) of segment `k`: the elements, then a ready flag per element.
+#define __vec_concurrent_seg_bytes(c, k) (__vec_seg_size(k) * ((c)->elemsize + 1))
+
+/*
+ * Returns the ready flag of slot `idx`, or NULL if its segment does not exist.
+ */
+static unsigned char *
+__vec_concurrent_flag(
+    vec_concurrent_t *c,
+    size_t idx)
+{
+  size_t k, off;
+  __vec_seg_locate(idx, &k, &off);
+  if(k >= VEC_SEG_MAX) {
+    return NULL;
+  }
+  unsigned char *seg = (unsigned char *)__vec_atomic_load_ptr(&c->segments[k], __VEC_ACQUIRE);
+  return seg ? seg + (__vec_seg_size(k) * c->elemsize) + off : NULL;
+}
+
+/*
+ * Advances `committed` over the slots that are ready and returns it.
+ */
+static size_t
+__vec_concurrent_advance(
+    vec_concurrent_t *c)
+{
+  size_t idx = __vec_atomic_load(&c->committed, __VEC_ACQUIRE);
+  for(;;) {
+    unsigned char *flag = __vec_concurrent_flag(c, idx);
+    if(!flag || !__vec_atomic_load8(flag, __VEC_ACQUIRE)) {
+      return idx;
+    }
+    if(__vec_atomic_cas(&c->committed, idx, idx + 1, __VEC_RELEASE)) {
+      idx++;
+    } else {
+      idx = __vec_atomic_load(&c->committed, __VEC_ACQUIRE);
+    }
+  }
+}
+
+/*
+ * Waits until the claimed slot `idx` is ready. The push being waited on is
+ * only copying an element, so this spins briefly before yielding.
+ */
+static void
+__vec_concurrent_wait(
+    vec_concurrent_t *c,
+    size_t idx)
+{
+  unsigned char *flag = __vec_concurrent_flag(c, idx);
+  for(unsigned spins = 0; !__vec_atomic_load8(flag, __VEC_ACQUIRE); spins++) {
+    if(spins >= 64) {
+      __vec_yield();
+    }
+  }
+}
+
+void
+vec_concurrent_init(
+    vec_concurrent_t *c,
+    size_t elemsize,
+    elem_copy copy,
+    elem_destr destr)
+{
+  memset(c, 0, sizeof(*c));
+  c->elemsize  = elemsize;
+  c->copy_fn   = copy;
+  c->destr_fn  = destr;
+  c->allocator = __vec_default_allocator;
+}
+
+// Releases every segment without touching the elements.
+static void
+__vec_concurrent_release(
+    vec_concurrent_t *c)
+{
+  // A push that lost the race with a freeze may have published a segment past
+  // the first missing one.
+  for(size_t k = 0; k < VEC_SEG_MAX; k++) {
+    void *seg = __vec_atomic_exchange_ptr(&c->segments[k], NULL, __VEC_ACQUIRE);
+    if(seg) {
+      c->allocator->free_fn(c->allocator->ctx, seg, __vec_concurrent_seg_bytes(c, k));
+    }
+  }
+  __vec_atomic_store(&c->committed, 0, __VEC_RELAXED);
+  __vec_atomic_store(&c->length, 0, __VEC_RELEASE);
+}
+
+void
+vec_concurrent_fini(
+    vec_concurrent_t *c)
+{
+  if(c->destr_fn) {
+    size_t length = __vec_concurrent_advance(c);
+    for(size_t i = 0; i < length; i++) {
+      c->destr_fn(vec_concurrent_at(c, i));
+    }
+  }
+  __vec_concurrent_release(c);
+}
+
+int
+vec_concurrent_push(
+    vec_concurrent_t *c,
+    const void *val)
+{
+  size_t idx, k, off;
+  char *seg;
+
+  for(;;) {
+    idx = __vec_atomic_load(&c->length, __VEC_RELAXED);
+    if(idx == __VEC_CONCURRENT_CLOSED) {
+      return VEC_ERR_OUT_OF_BOUNDS;
+    }
+    // Keeps `__vec_seg_locate()` from overflowing.
+    if(idx >= __VEC_CONCURRENT_CLOSED - __vec_seg_size(0)) {
+      return VEC_ERR_OOM;
+    }
+    __vec_seg_locate(idx, &k, &off);
+    if(k >= VEC_SEG_MAX) {
+      return VEC_ERR_OOM;
+    }
+
+    seg = (char *)__vec_atomic_load_ptr(&c->segments[k], __VEC_ACQUIRE);
+    if(!seg) {
+      char *fresh = (char *)c->allocator->alloc_fn(c->allocator->ctx, __vec_concurrent_seg_bytes(c, k));
+      if(!fresh) {
+        return VEC_ERR_OOM;
+      }
+      memset(fresh + (__vec_seg_size(k) * c->elemsize), 0, __vec_seg_size(k));
+      if(!__vec_atomic_cas_ptr(&c->segments[k], NULL, fresh, __VEC_SEQ_CST)) {
+        // Another thread published the segment first.
+        c->allocator->free_fn(c->allocator->ctx, fresh, __vec_concurrent_seg_bytes(c, k));
+      }
+      continue;
+    }
+
+    if(__vec_atomic_cas(&c->length, idx, idx + 1, __VEC_RELAXED)) {
+      break;
+    }
+  }
+
+  void *dst = seg + (off * c->elemsize);
+  if(c->copy_fn) {
+    c->copy_fn(dst, val);
+  } else {
+    memcpy(dst, val, c->elemsize);
+  }
+
+  // Last access to the vector: once the flag is set, a freeze may free the
+  // segment.
+  __vec_atomic_store8(seg + (__vec_seg_size(k) * c->elemsize) + off, 1, __VEC_RELEASE);
+
+  return (int)idx;
+}
+
+void *
+vec_concurrent_at(
+    vec_concurrent_t *c,
+    size_t idx)
+{
+  size_t k, off;
+  __vec_seg_locate(idx, &k, &off);
+  return (char *)__vec_atomic_load_ptr(&c->segments[k], __VEC_ACQUIRE) + (off * c->elemsize);
+}
+
+size_t
+vec_concurrent_len(
+    vec_concurrent_t *c)
+{
+  return __vec_concurrent_advance(c);
+}
 
 vec_t
-vec_init_impl(
-    size_t elemsize, 
-    elem_copy copy, 
+vec_concurrent_freeze(
+    vec_concurrent_t *c)
+{
+  // Closes the vector to new pushes, then waits for the ones that already
+  // claimed a slot, so that no segment is copied or freed under a producer.
+  size_t length;
+  do {
+    length = __vec_atomic_load(&c->length, __VEC_RELAXED);
+    if(length == __VEC_CONCURRENT_CLOSED) {
+      return NULL;
+    }
+  } while(!__vec_atomic_cas(&c->length, length, __VEC_CONCURRENT_CLOSED, __VEC_SEQ_CST));
+  for(size_t i = __vec_concurrent_advance(c); i < length; i++) {
+    __vec_concurrent_wait(c, i);
+  }
+
+  vec_t v = vec_init_w_allocator_impl(c->elemsize, c->copy_fn, c->destr_fn, c->allocator);
+  if(v && vec_reserve(&v, length)) {
+    vec_fini(v);
+    v = NULL;
+  }
+  if(!v) {
+    __vec_atomic_store(&c->length, length, __VEC_RELEASE);
+    return NULL;
+  }
+
+  char *dst = (char *)v;
+  for(size_t k = 0, copied = 0; copied < length; k++) {
+    size_t n = __vec_seg_size(k);
+    if(n > length - copied) {
+      n = length - copied;
+    }
+    memcpy(dst + (copied * c->elemsize), __vec_atomic_load_ptr(&c->segments[k], __VEC_ACQUIRE), n * c->elemsize);
+    copied += n;
+  }
+  __vec_hdr(v)->length = length;
+
+  __vec_concurrent_release(c);
+  return v;
+}
+
+
+void
+vec_seg_init(
+    vec_seg_t *s,
+    size_t elemsize,
+    elem_copy copy,
+    elem_destr destr)
+{
+  memset(s, 0, sizeof(*s));
+  s->elemsize  = elemsize;
+  s->copy_fn   = copy;
+  s->destr_fn  = destr;
+  s->allocator = __vec_default_allocator;
+}
+
+void
+vec_seg_fini(
+    vec_seg_t *s)
+{
+  if(s->destr_fn) {
+    void *elem;
+    vec_seg_foreach(elem, s) {
+      s->destr_fn(elem);
+    }
+  }
+  for(size_t k = 0; k < s->nsegments; k++) {
+    s->allocator->free_fn(s->allocator->ctx, s->segments[k], __vec_seg_size(k) * s->elemsize);
+    s->segments[k] = NULL;
+  }
+  s->nsegments = 0;
+  s->length    = 0;
+}
+
+int
+vec_seg_push(
+    vec_seg_t *s,
+    const void *val)
+{
+  size_t k, off;
+  __vec_seg_locate(s->length, &k, &off);
+
+  if(k == s->nsegments) {
+    void *seg = s->allocator->alloc_fn(s->allocator->ctx, __vec_seg_size(k) * s->elemsize);
+    if(!seg) {
+      return VEC_ERR_OOM;
+    }
+    s->segments[s->nsegments++] = seg;
+  }
+
+  void *dst = (char *)s->segments[k] + (off * s->elemsize);
+  if(s->copy_fn) {
+    s->copy_fn(dst, val);
+  } else {
+    memcpy(dst, val, s->elemsize);
+  }
+
+  return (int)s->length++;
+}
+
+vec_error_t
+vec_seg_pop(
+    vec_seg_t *s,
+    void *out)
+{
+  if(s->length == 0) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  void *src = vec_seg_at(s, s->length - 1);
+  if(out) {
+    if(s->copy_fn) {
+      s->copy_fn(out, src);
+    } else {
+      memcpy(out, src, s->elemsize);
+    }
+  } else if(s->destr_fn) {
+    s->destr_fn(src);
+  }
+
+  s->length--;
+  return VEC_ERR_NONE;
+}
+
+void *
+vec_seg_at(
+    vec_seg_t *s,
+    size_t idx)
+{
+  if(idx >= s->length) {
+    return NULL;
+  }
+  size_t k, off;
+  __vec_seg_locate(idx, &k, &off);
+  return (char *)s->segments[k] + (off * s->elemsize);
+}
+
+size_t
+vec_seg_len(
+    vec_seg_t *s)
+{
+  return s->length;
+}
+
+
+/*
+ * Typed kernels. Every kernel is written once against GCC vector extensions
+ * and instantiated per instruction set with a `target` attribute, so the same
+ * code becomes SSE2, AVX2 or AVX-512 depending on the instantiation. Loads and
+ * stores go through memcpy since vector data is not guaranteed to be aligned.
+ */
+#define __VEC_SCALAR_KERNELS(T, sfx, ACC)                                 \
+  static ptrdiff_t                                                        \
+  __vec_find_##sfx##_scalar(                                              \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    for(size_t i = 0; i < n; i++) {                                       \
+      if(p[i] == val) {                                                   \
+        return (ptrdiff_t)i;                                              \
+      }                                                                   \
+    }                                                                     \
+    return -1;                                                            \
+  }                                                                       \
+                                                                          \
+  static size_t                                                           \
+  __vec_count_##sfx##_scalar(                                             \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    size_t count = 0;                                                     \
+    for(size_t i = 0; i < n; i++) {                                       \
+      count += p[i] == val;                                               \
+    }                                                                     \
+    return count;                                                         \
+  }                                                                       \
+                                                                          \
+  static ACC                                                              \
+  __vec_sum_##sfx##_scalar(                                               \
+      const T *p,                                                         \
+      size_t n)                                                           \
+  {                                                                       \
+    ACC sum = 0;                                                          \
+    for(size_t i = 0; i < n; i++) {                                       \
+      sum += p[i];                                                        \
+    }                                                                     \
+    return sum;                                                           \
+  }                                                                       \
+                                                                          \
+  static void                                                             \
+  __vec_minmax_##sfx##_scalar(                                            \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T *min,                                                             \
+      T *max)                                                             \
+  {                                                                       \
+    T lo = p[0], hi = p[0];                                               \
+    for(size_t i = 1; i < n; i++) {                                       \
+      lo = p[i] < lo ? p[i] : lo;                                         \
+      hi = p[i] > hi ? p[i] : hi;                                         \
+    }                                                                     \
+    *min = lo;                                                            \
+    *max = hi;                                                            \
+  }                                                                       \
+                                                                          \
+  static void                                                             \
+  __vec_fill_##sfx##_scalar(                                              \
+      T *p,                                                               \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    for(size_t i = 0; i < n; i++) {                                       \
+      p[i] = val;                                                         \
+    }                                                                     \
+  }
+
+#if !defined(VEC_NO_SIMD) && \
+    ((defined(__GNUC__) && __GNUC__ >= 9) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#define __VEC_SIMD
+#endif
+
+#ifdef __VEC_SIMD
+/*
+ * `W` is the vector width in bytes and `M` the signed integer type of the
+ * same size as `T`, which comparisons produce.
+ */
+#define __VEC_SIMD_KERNELS(T, sfx, ACC, M, isa, W, ATTR)                  \
+  typedef T   __vec_##sfx##_##isa##_v __attribute__((vector_size(W)));  \
+  typedef M   __vec_##sfx##_##isa##_m __attribute__((vector_size(W)));  \
+  typedef ACC __vec_##sfx##_##isa##_a                                     \
+      __attribute__((vector_size((W) / sizeof(T) * sizeof(ACC))));       \
+                                                                          \
+  ATTR static ptrdiff_t                                                   \
+  __vec_find_##sfx##_##isa(                                               \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    const size_t lanes = (W) / sizeof(T);                                 \
+    __vec_##sfx##_##isa##_v key = (__vec_##sfx##_##isa##_v){ 0 } + val;   \
+    size_t i = 0;                                                         \
+    for(; i + (2 * lanes) <= n; i += 2 * lanes) {                         \
+      __vec_##sfx##_##isa##_v x, y;                                       \
+      memcpy(&x, p + i, W);                                               \
+      memcpy(&y, p + i + lanes, W);                                       \
+      __vec_##sfx##_##isa##_m hit = (x == key) | (y == key);              \
+      uint64_t words[(W) / 8], any = 0;                                   \
+      memcpy(words, &hit, W);                                             \
+      for(size_t k = 0; k < (W) / 8; k++) {                               \
+        any |= words[k];                                                  \
+      }                                                                   \
+      if(any) {                                                           \
+        break;                                                            \
+      }                                                                   \
+    }                                                                     \
+    for(; i < n; i++) {                                                   \
+      if(p[i] == val) {                                                   \
+        return (ptrdiff_t)i;                                              \
+      }                                                                   \
+    }                                                                     \
+    return -1;                                                            \
+  }                                                                       \
+                                                                          \
+  ATTR static size_t                                                      \
+  __vec_count_##sfx##_##isa(                                              \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    const size_t lanes = (W) / sizeof(T);                                 \
+    __vec_##sfx##_##isa##_v key = (__vec_##sfx##_##isa##_v){ 0 } + val;   \
+    size_t count = 0, i = 0;                                              \
+    while(i + lanes <= n) {                                               \
+      /* Matches are -1 per lane; flush before a lane can overflow. */    \
+      __vec_##sfx##_##isa##_m acc = { 0 };                                \
+      for(size_t step = 0; step < ((size_t)1 << 24) && i + lanes <= n;   \
+          step++, i += lanes) {                                           \
+        __vec_##sfx##_##isa##_v x;                                        \
+        memcpy(&x, p + i, W);                                             \
+        acc -= (x == key);                                                \
+      }                                                                   \
+      M part[(W) / sizeof(T)];                                            \
+      memcpy(part, &acc, W);                                              \
+      for(size_t k = 0; k < lanes; k++) {                                 \
+        count += (size_t)part[k];                                         \
+      }                                                                   \
+    }                                                                     \
+    for(; i < n; i++) {                                                   \
+      count += p[i] == val;                                               \
+    }                                                                     \
+    return count;                                                         \
+  }                                                                       \
+                                                                          \
+  ATTR static ACC                                                         \
+  __vec_sum_##sfx##_##isa(                                                \
+      const T *p,                                                         \
+      size_t n)                                                           \
+  {                                                                       \
+    const size_t lanes = (W) / sizeof(T);                                 \
+    __vec_##sfx##_##isa##_a acc0 = { 0 }, acc1 = { 0 };                   \
+    size_t i = 0;                                                         \
+    for(; i + (2 * lanes) <= n; i += 2 * lanes) {                         \
+      __vec_##sfx##_##isa##_v x, y;                                       \
+      memcpy(&x, p + i, W);                                               \
+      memcpy(&y, p + i + lanes, W);                                       \
+      acc0 += __builtin_convertvector(x, __vec_##sfx##_##isa##_a);        \
+      acc1 += __builtin_convertvector(y, __vec_##sfx##_##isa##_a);        \
+    }                                                                     \
+    acc0 += acc1;                                                         \
+    ACC part[(W) / sizeof(T)], sum = 0;                                   \
+    memcpy(part, &acc0, sizeof(acc0));                                    \
+    for(size_t k = 0; k < lanes; k++) {                                   \
+      sum += part[k];                                                     \
+    }                                                                     \
+    for(; i < n; i++) {                                                   \
+      sum += p[i];                                                        \
+    }                                                                     \
+    return sum;                                                           \
+  }                                                                       \
+                                                                          \
+  ATTR static void                                                        \
+  __vec_minmax_##sfx##_##isa(                                             \
+      const T *p,                                                         \
+      size_t n,                                                           \
+      T *min,                                                             \
+      T *max)                                                             \
+  {                                                                       \
+    const size_t lanes = (W) / sizeof(T);                                 \
+    T lo = p[0], hi = p[0];                                               \
+    size_t i = 0;                                                         \
+    if(n >= lanes) {                                                      \
+      __vec_##sfx##_##isa##_v vlo, vhi;                                   \
+      memcpy(&vlo, p, W);                                                 \
+      vhi = vlo;                                                          \
+      for(i = lanes; i + lanes <= n; i += lanes) {                        \
+        __vec_##sfx##_##isa##_v x;                                        \
+        memcpy(&x, p + i, W);                                             \
+        __vec_##sfx##_##isa##_m lt = x < vlo, gt = x > vhi;               \
+        vlo = (__vec_##sfx##_##isa##_v)(((__vec_##sfx##_##isa##_m)x & lt) | \
+              ((__vec_##sfx##_##isa##_m)vlo & ~lt));                      \
+        vhi = (__vec_##sfx##_##isa##_v)(((__vec_##sfx##_##isa##_m)x & gt) | \
+              ((__vec_##sfx##_##isa##_m)vhi & ~gt));                      \
+      }                                                                   \
+      T plo[(W) / sizeof(T)], phi[(W) / sizeof(T)];                       \
+      memcpy(plo, &vlo, W);                                               \
+      memcpy(phi, &vhi, W);                                               \
+      for(size_t k = 0; k < lanes; k++) {                                 \
+        lo = plo[k] < lo ? plo[k] : lo;                                   \
+        hi = phi[k] > hi ? phi[k] : hi;                                   \
+      }                                                                   \
+    }                                                                     \
+    for(; i < n; i++) {                                                   \
+      lo = p[i] < lo ? p[i] : lo;                                         \
+      hi = p[i] > hi ? p[i] : hi;                                         \
+    }                                                                     \
+    *min = lo;                                                            \
+    *max = hi;                                                            \
+  }                                                                       \
+                                                                          \
+  ATTR static void                                                        \
+  __vec_fill_##sfx##_##isa(                                               \
+      T *p,                                                               \
+      size_t n,                                                           \
+      T val)                                                              \
+  {                                                                       \
+    const size_t lanes = (W) / sizeof(T);                                 \
+    __vec_##sfx##_##isa##_v key = (__vec_##sfx##_##isa##_v){ 0 } + val;   \
+    size_t i = 0;                                                         \
+    for(; i + lanes <= n; i += lanes) {                                   \
+      memcpy(p + i, &key, W);                                             \
+    }                                                                     \
+    for(; i < n; i++) {                                                   \
+      p[i] = val;                                                         \
+    }                                                                     \
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+#define __VEC_SIMD_ISAS(T, sfx, ACC, M)                                   \
+  __VEC_SIMD_KERNELS(T, sfx, ACC, M, sse2, 16, __attribute__((target("sse2")))) \
+  __VEC_SIMD_KERNELS(T, sfx, ACC, M, avx2, 32, __attribute__((target("avx2")))) \
+  __VEC_SIMD_KERNELS(T, sfx, ACC, M, avx512, 64, __attribute__((target("avx512f"))))
+
+enum {
+  __VEC_SIMD_UNKNOWN = 0,
+  __VEC_SIMD_SCALAR,
+  __VEC_SIMD_SSE2,
+  __VEC_SIMD_AVX2,
+  __VEC_SIMD_AVX512,
+};
+
+static size_t __vec_simd_level;
+
+static size_t
+__vec_simd_detect(void)
+{
+  size_t level = __vec_atomic_load(&__vec_simd_level, __VEC_RELAXED);
+  if(level == __VEC_SIMD_UNKNOWN) {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+      level = __VEC_SIMD_AVX512;
+    } else if(__builtin_cpu_supports("avx2")) {
+      level = __VEC_SIMD_AVX2;
+    } else if(__builtin_cpu_supports("sse2")) {
+      level = __VEC_SIMD_SSE2;
+    } else {
+      level = __VEC_SIMD_SCALAR;
+    }
+    __vec_atomic_store(&__vec_simd_level, level, __VEC_RELAXED);
+  }
+  return level;
+}
+
+//! The implementation of kernel `op` for the instruction set of this CPU.
+#define __VEC_SIMD_SELECT(op, sfx)                                        \
+  (__vec_simd_detect() == __VEC_SIMD_AVX512 ? __vec_##op##_##sfx##_avx512 : \
+   __vec_simd_detect() == __VEC_SIMD_AVX2   ? __vec_##op##_##sfx##_avx2   : \
+   __vec_simd_detect() == __VEC_SIMD_SSE2   ? __vec_##op##_##sfx##_sse2   : \
+                                              __vec_##op##_##sfx##_scalar)
+#else
+// NEON is part of the baseline of AArch64, so no dispatch is needed.
+#define __VEC_SIMD_ISAS(T, sfx, ACC, M)                                   \
+  __VEC_SIMD_KERNELS(T, sfx, ACC, M, neon, 16, )
+
+#define __VEC_SIMD_SELECT(op, sfx) __vec_##op##_##sfx##_neon
+#endif
+#else
+#define __VEC_SIMD_ISAS(T, sfx, ACC, M)
+#define __VEC_SIMD_SELECT(op, sfx) __vec_##op##_##sfx##_scalar
+#endif
+
+#define __VEC_DEFINE_KERNELS(T, sfx, ACC, M)                              \
+  __VEC_SCALAR_KERNELS(T, sfx, ACC)                                       \
+  __VEC_SIMD_ISAS(T, sfx, ACC, M)                                         \
+                                                                          \
+  ptrdiff_t                                                               \
+  vec_find_##sfx(                                                         \
+      const T *v,                                                         \
+      T val)                                                              \
+  {                                                                       \
+    return __VEC_SIMD_SELECT(find, sfx)(v, vec_len((vec_t)v), val);      \
+  }                                                                       \
+                                                                          \
+  size_t                                                                  \
+  vec_count_##sfx(                                                        \
+      const T *v,                                                         \
+      T val)                                                              \
+  {                                                                       \
+    return __VEC_SIMD_SELECT(count, sfx)(v, vec_len((vec_t)v), val);     \
+  }                                                                       \
+                                                                          \
+  ACC                                                                     \
+  vec_sum_##sfx(                                                          \
+      const T *v)                                                         \
+  {                                                                       \
+    return __VEC_SIMD_SELECT(sum, sfx)(v, vec_len((vec_t)v));            \
+  }                                                                       \
+                                                                          \
+  vec_error_t                                                             \
+  vec_minmax_##sfx(                                                       \
+      const T *v,                                                         \
+      T *min,                                                             \
+      T *max)                                                             \
+  {                                                                       \
+    size_t n = vec_len((vec_t)v);                                         \
+    if(n == 0) {                                                          \
+      return VEC_ERR_OUT_OF_BOUNDS;                                       \
+    }                                                                     \
+    T lo, hi;                                                             \
+    __VEC_SIMD_SELECT(minmax, sfx)(v, n, &lo, &hi);                       \
+    if(min) {                                                             \
+      *min = lo;                                                          \
+    }                                                                     \
+    if(max) {                                                             \
+      *max = hi;                                                          \
+    }                                                                     \
+    return VEC_ERR_NONE;                                                  \
+  }                                                                       \
+                                                                          \
+  vec_error_t                                                             \
+  vec_fill_##sfx(                                                         \
+      T **v,                                                              \
+      T val)                                                              \
+  {                                                                       \
+    if(vec_unshare((vec_t *)v)) {                                         \
+      return VEC_ERR_OOM;                                                 \
+    }                                                                     \
+    __VEC_SIMD_SELECT(fill, sfx)(*v, vec_len(*v), val);                   \
+    return VEC_ERR_NONE;                                                  \
+  }
+
+__VEC_DEFINE_KERNELS(int32_t, i32, int64_t, int32_t)
+__VEC_DEFINE_KERNELS(uint32_t, u32, uint64_t, int32_t)
+__VEC_DEFINE_KERNELS(int64_t, i64, int64_t, int64_t)
+__VEC_DEFINE_KERNELS(uint64_t, u64, uint64_t, int64_t)
+__VEC_DEFINE_KERNELS(float, f32, float, int32_t)
+__VEC_DEFINE_KERNELS(double, f64, double, int64_t)
+
+
+/*
+ * Sorts `n` records of `size` bytes by their first `key_bytes` (4 or 8)
+ * bytes, read as an unsigned integer. Uses `tmp` as scratch space for `n`
+ * records; the result ends up in `data`.
+ */
+static void
+__vec_radix_sort(
+    void *data,
+    void *tmp,
+    size_t n,
+    size_t size,
+    size_t key_bytes)
+{
+  size_t counts[8][256] = { { 0 } };
+  for(size_t i = 0; i < n; i++) {
+    uint64_t key;
+    if(key_bytes == 4) {
+      uint32_t k32;
+      memcpy(&k32, (char *)data + (i * size), 4);
+      key = k32;
+    } else {
+      memcpy(&key, (char *)data + (i * size), 8);
+    }
+    for(size_t d = 0; d < key_bytes; d++) {
+      counts[d][(key >> (d * 8)) & 0xff]++;
+    }
+  }
+
+  char *src = (char *)data, *dst = (char *)tmp;
+  for(size_t d = 0; d < key_bytes; d++) {
+    size_t offsets[256], sum = 0, skip = 0;
+    for(size_t b = 0; b < 256; b++) {
+      skip |= counts[d][b] == n;
+      offsets[b] = sum;
+      sum += counts[d][b];
+    }
+    if(skip) {
+      continue;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+      uint64_t key;
+      if(key_bytes == 4) {
+        uint32_t k32;
+        memcpy(&k32, src + (i * size), 4);
+        key = k32;
+      } else {
+        memcpy(&key, src + (i * size), 8);
+      }
+      memcpy(dst + (offsets[(key >> (d * 8)) & 0xff]++ * size), src + (i * size), size);
+    }
+    char *t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if(src != (char *)data) {
+    memcpy(data, src, n * size);
+  }
+}
+
+/*
+ * Maps keys to unsigned integers that sort in the same order, and back.
+ */
+#define __vec_key_i32(x) ((uint32_t)(x) ^ UINT32_C(0x80000000))
+#define __vec_key_i64(x) ((uint64_t)(x) ^ UINT64_C(0x8000000000000000))
+#define __vec_key_f32(x) ((x) & UINT32_C(0x80000000) ? ~(x) : (x) ^ UINT32_C(0x80000000))
+#define __vec_key_f64(x) ((x) & UINT64_C(0x8000000000000000) ? ~(x) : (x) ^ UINT64_C(0x8000000000000000))
+#define __vec_unkey_f32(x) ((x) & UINT32_C(0x80000000) ? (x) ^ UINT32_C(0x80000000) : ~(x))
+#define __vec_unkey_f64(x) ((x) & UINT64_C(0x8000000000000000) ? (x) ^ UINT64_C(0x8000000000000000) : ~(x))
+
+#define __VEC_DEFINE_SORT(T, sfx, U, KEY, UNKEY)                          \
+  static int                                                              \
+  __vec_cmp_##sfx(                                                        \
+      const void *a,                                                      \
+      const void *b)                                                      \
+  {                                                                       \
+    U x, y;                                                               \
+    memcpy(&x, a, sizeof(U));                                             \
+    memcpy(&y, b, sizeof(U));                                             \
+    x = KEY(x);                                                           \
+    y = KEY(y);                                                           \
+    return (x > y) - (x < y);                                             \
+  }                                                                       \
+                                                                          \
+  vec_error_t                                                             \
+  vec_sort_##sfx(                                                         \
+      T **v)                                                              \
+  {                                                                       \
+    if(vec_unshare((vec_t *)v)) {                                         \
+      return VEC_ERR_OOM;                                                 \
+    }                                                                     \
+    size_t n = vec_len(*v);                                               \
+    const vec_allocator_t *allocator = __vec_allocator_of(__vec_hdr(*v)); \
+    U *tmp = n > 1 ? (U *)allocator->alloc_fn(allocator->ctx, n * sizeof(U)) : NULL; \
+    if(!tmp) {                                                            \
+      qsort(*v, n, sizeof(T), __vec_cmp_##sfx);                           \
+      return VEC_ERR_NONE;                                                \
+    }                                                                     \
+                                                                          \
+    U *keys = (U *)(void *)*v;                                            \
+    for(size_t i = 0; i < n; i++) {                                       \
+      keys[i] = KEY(keys[i]);                                             \
+    }                                                                     \
+    __vec_radix_sort(keys, tmp, n, sizeof(U), sizeof(U));                 \
+    for(size_t i = 0; i < n; i++) {                                       \
+      keys[i] = UNKEY(keys[i]);                                           \
+    }                                                                     \
+    allocator->free_fn(allocator->ctx, tmp, n * sizeof(U));               \
+    return VEC_ERR_NONE;                                                  \
+  }
+
+__VEC_DEFINE_SORT(int32_t, i32, uint32_t, __vec_key_i32, __vec_key_i32)
+__VEC_DEFINE_SORT(uint32_t, u32, uint32_t, , )
+__VEC_DEFINE_SORT(int64_t, i64, uint64_t, __vec_key_i64, __vec_key_i64)
+__VEC_DEFINE_SORT(uint64_t, u64, uint64_t, , )
+__VEC_DEFINE_SORT(float, f32, uint32_t, __vec_key_f32, __vec_unkey_f32)
+__VEC_DEFINE_SORT(double, f64, uint64_t, __vec_key_f64, __vec_unkey_f64)
+
+struct __vec_key_index {
+  uint64_t key;
+  uint64_t index;
+};
+
+vec_error_t
+vec_sort_by_key(
+    vec_t *v,
+    size_t key_offset,
+    vec_key_type_t key_type)
+{
+  __GET_METADATA__(*v)
+
+  size_t n = metadata->length, elemsize = metadata->elemsize;
+  if(n < 2) {
+    return VEC_ERR_NONE;
+  }
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  size_t pairs_size = 2 * n * sizeof(struct __vec_key_index);
+  const vec_allocator_t *allocator = __vec_allocator_of(metadata);
+  struct __vec_key_index *pairs = (struct __vec_key_index *)allocator->alloc_fn(allocator->ctx, pairs_size);
+  char *sorted = (char *)allocator->alloc_fn(allocator->ctx, n * elemsize);
+  if(!pairs || !sorted) {
+    if(pairs) {
+      allocator->free_fn(allocator->ctx, pairs, pairs_size);
+    }
+    if(sorted) {
+      allocator->free_fn(allocator->ctx, sorted, n * elemsize);
+    }
+    return VEC_ERR_OOM;
+  }
+
+  int wide = key_type == VEC_KEY_I64 || key_type == VEC_KEY_U64 || key_type == VEC_KEY_F64;
+  for(size_t i = 0; i < n; i++) {
+    const char *key = (const char *)*v + (i * elemsize) + key_offset;
+    uint32_t k32 = 0;
+    uint64_t k64 = 0;
+    if(wide) {
+      memcpy(&k64, key, 8);
+    } else {
+      memcpy(&k32, key, 4);
+    }
+    switch(key_type) {
+      case VEC_KEY_I32: k64 = __vec_key_i32(k32); break;
+      case VEC_KEY_U32: k64 = k32; break;
+      case VEC_KEY_F32: k64 = __vec_key_f32(k32); break;
+      case VEC_KEY_I64: k64 = __vec_key_i64(k64); break;
+      case VEC_KEY_F64: k64 = __vec_key_f64(k64); break;
+      case VEC_KEY_U64: break;
+    }
+    pairs[i].key   = k64;
+    pairs[i].index = i;
+  }
+
+  __vec_radix_sort(pairs, pairs + n, n, sizeof(struct __vec_key_index), wide ? 8 : 4);
+
+  for(size_t i = 0; i < n; i++) {
+    memcpy(sorted + (i * elemsize), (char *)*v + (pairs[i].index * elemsize), elemsize);
+  }
+  memcpy(*v, sorted, n * elemsize);
+
+  allocator->free_fn(allocator->ctx, sorted, n * elemsize);
+  allocator->free_fn(allocator->ctx, pairs, pairs_size);
+  return VEC_ERR_NONE;
+}
+
+//! Number of chunks that a parallel `vec_sort()` is split into. Power of two.
+#define __VEC_SORT_CHUNKS 16
+
+struct __vec_sort_task {
+  char *src;
+  char *dst;
+  size_t elemsize;
+  size_t bounds[__VEC_SORT_CHUNKS + 1];
+  //! Number of chunks that each input run of the current merge pass spans.
+  size_t width;
+  vec_cmp_fn cmp;
+};
+
+static void
+__vec_sort_chunk_job(
+    void *data,
+    size_t idx)
+{
+  struct __vec_sort_task *task = (struct __vec_sort_task *)data;
+  size_t begin = task->bounds[idx];
+  qsort(task->src + (begin * task->elemsize), task->bounds[idx + 1] - begin, task->elemsize, task->cmp);
+}
+
+static void
+__vec_sort_merge_job(
+    void *data,
+    size_t idx)
+{
+  struct __vec_sort_task *task = (struct __vec_sort_task *)data;
+  size_t elemsize = task->elemsize;
+  size_t first = idx * 2 * task->width;
+  size_t i   = task->bounds[first];
+  size_t mid = task->bounds[first + task->width];
+  size_t end = task->bounds[first + (2 * task->width)];
+  size_t j = mid, out = i;
+
+  while(i < mid && j < end) {
+    // Taking from the left run on ties keeps equal elements in order.
+    if(task->cmp(task->src + (j * elemsize), task->src + (i * elemsize)) < 0) {
+      memcpy(task->dst + (out++ * elemsize), task->src + (j++ * elemsize), elemsize);
+    } else {
+      memcpy(task->dst + (out++ * elemsize), task->src + (i++ * elemsize), elemsize);
+    }
+  }
+  memcpy(task->dst + (out * elemsize), task->src + (i * elemsize), (mid - i) * elemsize);
+  out += mid - i;
+  memcpy(task->dst + (out * elemsize), task->src + (j * elemsize), (end - j) * elemsize);
+}
+
+vec_error_t
+vec_sort(
+    vec_t *v,
+    vec_cmp_fn cmp)
+{
+  __GET_METADATA__(*v)
+  __VEC_UNSHARE_OR__(v, VEC_ERR_OOM)
+
+  size_t n = metadata->length, elemsize = metadata->elemsize;
+  char *tmp = NULL;
+  const vec_allocator_t *allocator = __vec_allocator_of(metadata);
+  int parallel = n >= VEC_SORT_PARALLEL_MIN;
+#ifndef VEC_PARALLEL
+  // Without a pool, only an installed job system can run the chunks in parallel.
+  parallel = parallel && __vec_jobs != &__vec_builtin_jobs;
+#endif
+  if(parallel) {
+    tmp = (char *)allocator->alloc_fn(allocator->ctx, n * elemsize);
+  }
+  if(!tmp) {
+    qsort(*v, n, elemsize, cmp);
+    return VEC_ERR_NONE;
+  }
+
+  struct __vec_sort_task task = {
+    .src      = (char *)*v,
+    .dst      = tmp,
+    .elemsize = elemsize,
+    .cmp      = cmp,
+  };
+  for(size_t k = 0; k <= __VEC_SORT_CHUNKS; k++) {
+    task.bounds[k] = (n / __VEC_SORT_CHUNKS) * k + (k == __VEC_SORT_CHUNKS ? n % __VEC_SORT_CHUNKS : 0);
+  }
+
+  __vec_jobs->run_fn(__vec_jobs->ctx, __VEC_SORT_CHUNKS, __vec_sort_chunk_job, &task);
+  for(task.width = 1; task.width < __VEC_SORT_CHUNKS; task.width *= 2) {
+    __vec_jobs->run_fn(__vec_jobs->ctx, __VEC_SORT_CHUNKS / (2 * task.width), __vec_sort_merge_job, &task);
+    char *t  = task.src;
+    task.src = task.dst;
+    task.dst = t;
+  }
+  if(task.src != (char *)*v) {
+    memcpy(*v, task.src, n * elemsize);
+  }
+
+  allocator->free_fn(allocator->ctx, tmp, n * elemsize);
+  return VEC_ERR_NONE;
+}
+
+size_t
+vec_lower_bound(
+    vec_t v,
+    const void *key,
+    vec_cmp_fn cmp)
+{
+  __GET_METADATA__(v)
+
+  size_t first = 0, count = metadata->length;
+  while(count > 0) {
+    size_t half = count / 2;
+    if(cmp((char *)v + ((first + half) * metadata->elemsize), key) < 0) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+void *
+vec_bsearch(
+    vec_t v,
+    const void *key,
+    vec_cmp_fn cmp)
+{
+  __GET_METADATA__(v)
+
+  size_t idx = vec_lower_bound(v, key, cmp);
+  if(idx == metadata->length) {
+    return NULL;
+  }
+  void *elem = (char *)v + (idx * metadata->elemsize);
+  return cmp(elem, key) == 0 ? elem : NULL;
+}
+
+
+// Bytes that a column of `cap` elements of `size` bytes takes in the block.
+static size_t
+__vec_soa_column_bytes(
+    size_t size,
+    size_t cap)
+{
+  return ((size * cap) + (VEC_CACHE_LINE - 1)) & ~(size_t)(VEC_CACHE_LINE - 1);
+}
+
+static void
+__vec_soa_sync_columns(
+    vec_soa_t *s,
+    void **columns,
+    size_t cap)
+{
+  size_t off = 0;
+  for(size_t i = 0; i < s->ncolumns; i++) {
+    columns[i] = (char *)s->block + off;
+    off += __vec_soa_column_bytes(s->sizes[i], cap);
+  }
+}
+
+vec_error_t
+vec_soa_init_impl(
+    vec_soa_t *s,
+    size_t ncolumns,
+    const size_t *sizes,
+    void **columns,
+    const vec_allocator_t *allocator)
+{
+  s->length   = 0;
+  s->capacity = 0;
+  s->ncolumns = ncolumns;
+  s->sizes    = sizes;
+  s->block    = vec_init_aligned_impl(1, VEC_CACHE_LINE, NULL, NULL, allocator);
+  if(!s->block) {
+    return VEC_ERR_OOM;
+  }
+  __vec_soa_sync_columns(s, columns, 0);
+  return VEC_ERR_NONE;
+}
+
+void
+vec_soa_fini_impl(
+    vec_soa_t *s,
+    void **columns)
+{
+  if(s->block) {
+    vec_fini(s->block);
+  }
+  s->block    = NULL;
+  s->length   = 0;
+  s->capacity = 0;
+  for(size_t i = 0; i < s->ncolumns; i++) {
+    columns[i] = NULL;
+  }
+}
+
+vec_error_t
+vec_soa_setcapacity_impl(
+    vec_soa_t *s,
+    void **columns,
+    size_t cap)
+{
+  if(cap == s->capacity) {
+    return VEC_ERR_NONE;
+  }
+
+  size_t row = 0;
+  for(size_t i = 0; i < s->ncolumns; i++) {
+    row += s->sizes[i];
+  }
+  if(cap > VEC_MAX_CAPACITY || (row && cap > (SIZE_MAX / 2) / row)) {
+    return VEC_ERR_OOM;
+  }
+
+  size_t old_bytes = 0, new_bytes = 0;
+  for(size_t i = 0; i < s->ncolumns; i++) {
+    old_bytes += __vec_soa_column_bytes(s->sizes[i], s->capacity);
+    new_bytes += __vec_soa_column_bytes(s->sizes[i], cap);
+  }
+  size_t len = s->length < cap ? s->length : cap;
+
+  if(cap < s->capacity) {
+    // Columns only move towards the front, so they are packed in order before
+    // the block is cut down. If the block cannot shrink it is kept as is.
+    size_t off = 0;
+    for(size_t i = 0; i < s->ncolumns; i++) {
+      memmove((char *)s->block + off, columns[i], len * s->sizes[i]);
+      off += __vec_soa_column_bytes(s->sizes[i], cap);
+    }
+    __vec_hdr(s->block)->length = new_bytes;
+    vec_setcapacity(&s->block, new_bytes ? new_bytes : 1);
+  } else {
+    // The block keeps its contents when it grows; the columns are then spread
+    // out from the last one, so none overwrites one that has not moved yet.
+    __vec_hdr(s->block)->length = old_bytes;
+    vec_error_t err = vec_setcapacity(&s->block, new_bytes);
+    if(err) {
+      return err;
+    }
+    size_t old_off = old_bytes, new_off = new_bytes;
+    for(size_t i = s->ncolumns; i-- > 0;) {
+      old_off -= __vec_soa_column_bytes(s->sizes[i], s->capacity);
+      new_off -= __vec_soa_column_bytes(s->sizes[i], cap);
+      memmove((char *)s->block + new_off, (char *)s->block + old_off, len * s->sizes[i]);
+    }
+    __vec_hdr(s->block)->length = new_bytes;
+  }
+
+  s->capacity = cap;
+  s->length   = len;
+  __vec_soa_sync_columns(s, columns, cap);
+  return VEC_ERR_NONE;
+}
+
+int
+vec_soa_push_impl(
+    vec_soa_t *s,
+    void **columns)
+{
+  if(s->length == s->capacity) {
+    vec_error_t err = vec_soa_setcapacity_impl(s, columns,
+        __vec_next_capacity(s->capacity, s->capacity + 1));
+    if(err) {
+      return err;
+    }
+  }
+  return (int)s->length++;
+}
+
+vec_error_t
+vec_soa_swap_remove_impl(
+    vec_soa_t *s,
+    void **columns,
+    size_t idx)
+{
+  if(idx >= s->length) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  size_t last = --s->length;
+  if(idx != last) {
+    for(size_t i = 0; i < s->ncolumns; i++) {
+      size_t size = s->sizes[i];
+      memcpy((char *)columns[i] + (idx * size), (char *)columns[i] + (last * size), size);
+    }
+  }
+  return VEC_ERR_NONE;
+}
+
+
+vec_error_t
+vec_ring_init(
+    vec_ring_t *r,
+    size_t elemsize,
+    size_t capacity,
+    elem_destr destr)
+{
+  size_t cap = 1;
+  while(cap < capacity) {
+    if(cap > VEC_MAX_CAPACITY / 2) {
+      return VEC_ERR_OOM;
+    }
+    cap <<= 1;
+  }
+
+  memset(r, 0, sizeof(*r));
+  r->buf = vec_init_aligned_impl(elemsize, VEC_CACHE_LINE, NULL, destr, NULL);
+  if(!r->buf) {
+    return VEC_ERR_OOM;
+  }
+  if(vec_setcapacity(&r->buf, cap)) {
+    vec_fini(r->buf);
+    r->buf = NULL;
+    return VEC_ERR_OOM;
+  }
+  r->mask     = cap - 1;
+  r->elemsize = elemsize;
+  return VEC_ERR_NONE;
+}
+
+void
+vec_ring_fini(
+    vec_ring_t *r)
+{
+  if(!r->buf) {
+    return;
+  }
+  // The vector's length stays 0, so only the queued elements are destroyed.
+  vec_ring_pop_n(r, NULL, r->tail - r->head);
+  vec_fini(r->buf);
+  r->buf = NULL;
+}
+
+// Number of elements from ring position `pos` up to the end of the buffer,
+// capped at `n`. The rest of a batch wraps around to the first slot.
+static size_t
+__vec_ring_run(
+    vec_ring_t *r,
+    size_t pos,
+    size_t n)
+{
+  size_t run = r->mask + 1 - (pos & r->mask);
+  return run < n ? run : n;
+}
+
+size_t
+vec_ring_push_n(
+    vec_ring_t *r,
+    const void *vals,
+    size_t n)
+{
+  size_t tail = r->tail;
+  size_t cap  = r->mask + 1;
+  if(cap - (tail - r->head_cache) < n) {
+    r->head_cache = __vec_atomic_load(&r->head, __VEC_ACQUIRE);
+  }
+  size_t space = cap - (tail - r->head_cache);
+  if(n > space) {
+    n = space;
+  }
+  if(n) {
+    size_t run = __vec_ring_run(r, tail, n);
+    memcpy((char *)r->buf + ((tail & r->mask) * r->elemsize), vals, run * r->elemsize);
+    memcpy(r->buf, (const char *)vals + (run * r->elemsize), (n - run) * r->elemsize);
+    __vec_atomic_store(&r->tail, tail + n, __VEC_RELEASE);
+  }
+  return n;
+}
+
+vec_error_t
+vec_ring_push(
+    vec_ring_t *r,
+    const void *val)
+{
+  return vec_ring_push_n(r, val, 1) ? VEC_ERR_NONE : VEC_ERR_OUT_OF_BOUNDS;
+}
+
+size_t
+vec_ring_pop_n(
+    vec_ring_t *r,
+    void *out,
+    size_t n)
+{
+  size_t head = r->head;
+  if(r->tail_cache - head < n) {
+    r->tail_cache = __vec_atomic_load(&r->tail, __VEC_ACQUIRE);
+  }
+  size_t avail = r->tail_cache - head;
+  if(n > avail) {
+    n = avail;
+  }
+  if(!n) {
+    return 0;
+  }
+  if(out) {
+    size_t run = __vec_ring_run(r, head, n);
+    memcpy(out, (char *)r->buf + ((head & r->mask) * r->elemsize), run * r->elemsize);
+    memcpy((char *)out + (run * r->elemsize), r->buf, (n - run) * r->elemsize);
+  } else {
+    elem_destr destr = __vec_meta_destr_fn(__vec_hdr(r->buf));
+    for(size_t i = 0; destr && i < n; i++) {
+      destr((char *)r->buf + (((head + i) & r->mask) * r->elemsize));
+    }
+  }
+  __vec_atomic_store(&r->head, head + n, __VEC_RELEASE);
+  return n;
+}
+
+vec_error_t
+vec_ring_pop(
+    vec_ring_t *r,
+    void *out)
+{
+  return vec_ring_pop_n(r, out, 1) ? VEC_ERR_NONE : VEC_ERR_OUT_OF_BOUNDS;
+}
+
+size_t
+vec_ring_len(
+    vec_ring_t *r)
+{
+  size_t head = __vec_atomic_load(&r->head, __VEC_ACQUIRE);
+  size_t tail = __vec_atomic_load(&r->tail, __VEC_ACQUIRE);
+  // `head` may have moved on while `tail` was read.
+  return tail - head > r->mask ? r->mask + 1 : tail - head;
+}
+
+size_t
+vec_ring_capacity(
+    vec_ring_t *r)
+{
+  return r->mask + 1;
+}
+
+
+// Slot of the element at `idx`, counted from the front of the deque.
+static char *
+__vec_deque_slot(
+    vec_deque_t *d,
+    size_t idx)
+{
+  struct vec_meta_t *metadata = __vec_hdr(d->buf);
+  return (char *)d->buf + (((d->head + idx) & (metadata->capacity - 1)) * metadata->elemsize);
+}
+
+/*
+ * Replaces the buffer with one of `cap` slots (a power of two, at least the
+ * length) that holds the elements from its first slot on. The old buffer is
+ * only released once the elements were relocated, so a failure leaves the
+ * deque untouched.
+ */
+static vec_error_t
+__vec_deque_rebuffer(
+    vec_deque_t *d,
+    size_t cap)
+{
+  struct vec_meta_t *metadata = __vec_hdr(d->buf);
+  vec_type_t type = __vec_meta_type(metadata);
+  vec_t fresh = __vec_init_heap(metadata->elemsize, metadata->alignment, &type, 0);
+  if(!fresh) {
+    return VEC_ERR_OOM;
+  }
+  if(vec_setcapacity(&fresh, cap)) {
+    vec_fini(fresh);
+    return VEC_ERR_OOM;
+  }
+
+  size_t run = metadata->capacity - d->head;
+  if(run > d->length) {
+    run = d->length;
+  }
+  __vec_relocate(metadata, fresh, __vec_deque_slot(d, 0), run);
+  __vec_relocate(metadata, (char *)fresh + (run * metadata->elemsize), d->buf, d->length - run);
+
+  vec_fini(d->buf);
+  d->buf  = fresh;
+  d->head = 0;
+  return VEC_ERR_NONE;
+}
+
+static vec_error_t
+__vec_deque_grow(
+    vec_deque_t *d)
+{
+  size_t cap = __vec_hdr(d->buf)->capacity;
+  if(cap > VEC_MAX_CAPACITY / 2) {
+    return VEC_ERR_OOM;
+  }
+  return __vec_deque_rebuffer(d, cap * 2);
+}
+
+vec_error_t
+vec_deque_init(
+    vec_deque_t *d,
+    size_t elemsize,
+    elem_copy copy,
     elem_destr destr)
 {
-  void *v = malloc(sizeof(struct vec_meta_t) + (VEC_INIT_CAP * elemsize));
-  if (!v)
+  d->head   = 0;
+  d->length = 0;
+  d->buf    = vec_init_impl(elemsize, copy, destr);
+  if(!d->buf) {
+    return VEC_ERR_OOM;
+  }
+
+  size_t cap = __vec_hdr(d->buf)->capacity;
+  if(cap & (cap - 1)) {
+    while(cap & (cap - 1)) {
+      cap &= cap - 1;
+    }
+    if(vec_setcapacity(&d->buf, cap << 1)) {
+      vec_fini(d->buf);
+      d->buf = NULL;
+      return VEC_ERR_OOM;
+    }
+  }
+  return VEC_ERR_NONE;
+}
+
+void
+vec_deque_fini(
+    vec_deque_t *d)
+{
+  if(!d->buf) {
+    return;
+  }
+  elem_destr destr = __vec_meta_destr_fn(__vec_hdr(d->buf));
+  if(destr) {
+    for(size_t i = 0; i < d->length; i++) {
+      destr(__vec_deque_slot(d, i));
+    }
+  }
+  vec_fini(d->buf);
+  d->buf    = NULL;
+  d->head   = 0;
+  d->length = 0;
+}
+
+// Copies `val` into `dst` the same way as `vec_push()`.
+static void
+__vec_deque_copy_in(
+    vec_deque_t *d,
+    void *dst,
+    const void *val)
+{
+  struct vec_meta_t *metadata = __vec_hdr(d->buf);
+  if(__vec_meta_copy_fn(metadata)) {
+    __vec_meta_copy_fn(metadata)(dst, val);
+  } else {
+    memcpy(dst, val, metadata->elemsize);
+  }
+  __VEC_STATS_PUSH(metadata, 1);
+}
+
+// Copies the element in `src` to `out` (or destroys it) the same way as `vec_pop()`.
+static void
+__vec_deque_copy_out(
+    vec_deque_t *d,
+    void *out,
+    void *src)
+{
+  struct vec_meta_t *metadata = __vec_hdr(d->buf);
+  if(out) {
+    if(__vec_meta_copy_fn(metadata)) {
+      __vec_meta_copy_fn(metadata)(out, src);
+    } else {
+      memcpy(out, src, metadata->elemsize);
+    }
+  } else if(__vec_meta_destr_fn(metadata)) {
+    __vec_meta_destr_fn(metadata)(src);
+  }
+}
+
+int
+vec_deque_push_back(
+    vec_deque_t *d,
+    const void *val)
+{
+  if(d->length == __vec_hdr(d->buf)->capacity) {
+    vec_error_t err = __vec_deque_grow(d);
+    if(err) {
+      return err;
+    }
+  }
+  __vec_deque_copy_in(d, __vec_deque_slot(d, d->length), val);
+  return (int)d->length++;
+}
+
+vec_error_t
+vec_deque_push_front(
+    vec_deque_t *d,
+    const void *val)
+{
+  size_t cap = __vec_hdr(d->buf)->capacity;
+  if(d->length == cap) {
+    vec_error_t err = __vec_deque_grow(d);
+    if(err) {
+      return err;
+    }
+    cap = __vec_hdr(d->buf)->capacity;
+  }
+  d->head = (d->head - 1) & (cap - 1);
+  d->length++;
+  __vec_deque_copy_in(d, __vec_deque_slot(d, 0), val);
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_deque_pop_back(
+    vec_deque_t *d,
+    void *out)
+{
+  if(d->length == 0) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  d->length--;
+  __vec_deque_copy_out(d, out, __vec_deque_slot(d, d->length));
+  return VEC_ERR_NONE;
+}
+
+vec_error_t
+vec_deque_pop_front(
+    vec_deque_t *d,
+    void *out)
+{
+  if(d->length == 0) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  __vec_deque_copy_out(d, out, __vec_deque_slot(d, 0));
+  d->head = (d->head + 1) & (__vec_hdr(d->buf)->capacity - 1);
+  d->length--;
+  return VEC_ERR_NONE;
+}
+
+void *
+vec_deque_at(
+    vec_deque_t *d,
+    size_t idx)
+{
+  if(idx >= d->length) {
     return NULL;
+  }
+  return __vec_deque_slot(d, idx);
+}
 
-  struct vec_meta_t *metadata = (struct vec_meta_t *)v;
-  *metadata = (struct vec_meta_t){
-    .length   = 0,
-    .capacity = VEC_INIT_CAP,
-    .elemsize = elemsize,
-    .allocationType = VEC_ALLOCATION_TYPE_HEAP,
-    .copy_fn  = copy,
-    .destr_fn = destr,
-  };
+size_t
+vec_deque_len(
+    vec_deque_t *d)
+{
+  return d->length;
+}
+
+vec_error_t
+vec_deque_reserve(
+    vec_deque_t *d,
+    size_t n)
+{
+  size_t cap = __vec_hdr(d->buf)->capacity;
+  if(n <= cap) {
+    return VEC_ERR_NONE;
+  }
+  while(cap < n) {
+    if(cap > VEC_MAX_CAPACITY / 2) {
+      return VEC_ERR_OOM;
+    }
+    cap <<= 1;
+  }
+  return __vec_deque_rebuffer(d, cap);
+}
+
+vec_t
+vec_deque_linearize(
+    vec_deque_t *d)
+{
+  struct vec_meta_t *metadata = __vec_hdr(d->buf);
+  if(d->head + d->length > metadata->capacity) {
+    if(__vec_deque_rebuffer(d, metadata->capacity)) {
+      return NULL;
+    }
+    metadata = __vec_hdr(d->buf);
+  } else if(d->head) {
+    __vec_relocate(metadata, d->buf, __vec_deque_slot(d, 0), d->length);
+  }
+
+  vec_t v = d->buf;
+  metadata->length = d->length;
+  d->buf    = NULL;
+  d->head   = 0;
+  d->length = 0;
+  return v;
+}
+
+
+// Copy of the vector with room for `cap` elements.
+static vec_t
+__vec_clone(
+    vec_t v,
+    size_t cap)
+{
+  __GET_METADATA__(v)
+
+  vec_type_t type = __vec_meta_type(metadata);
+  vec_t copy = __vec_init_heap(metadata->elemsize, metadata->alignment, &type, 0);
+  if(!copy) {
+    return NULL;
+  }
+  if(vec_setcapacity(&copy, cap)) {
+    vec_fini(copy);
+    return NULL;
+  }
 
-  return metadata + 1;
+  struct vec_meta_t *copy_meta = __vec_hdr(copy);
+  __vec_copy_range(copy_meta, copy, v, metadata->length);
+  copy_meta->length        = metadata->length;
+  copy_meta->shrink_policy = metadata->shrink_policy;
+  return copy;
 }
 
-void *
-vec_iter_begin(
+vec_t
+vec_clone(
     vec_t v)
 {
-  return v;
+  __GET_METADATA__(v)
+  return __vec_clone(v, metadata->length ? metadata->length : 1);
 }
 
-void *
-vec_iter_end(
+vec_t
+vec_share(
     vec_t v)
 {
   __GET_METADATA__(v)
 
-  return ((char *)v) + (metadata->elemsize * metadata->length);
+  if(metadata->allocationType != VEC_ALLOCATION_TYPE_HEAP) {
+    return vec_clone(v);
+  }
+
+  __vec_atomic_fetch_add32(&metadata->shared, 1, __VEC_RELAXED);
+  return v;
 }
 
-void
-vec_iter_next(
-    vec_t v, 
-    void **iter)
+vec_error_t
+vec_unshare(
+    vec_t *v)
 {
-  __GET_METADATA__(v)
-  *iter = ((char*)*iter) + metadata->elemsize;
+  __GET_METADATA__(*v)
+
+  if(!__vec_is_shared(metadata)) {
+    return VEC_ERR_NONE;
+  }
+
+  vec_t copy = __vec_clone(*v, metadata->capacity);
+  if(!copy) {
+    return VEC_ERR_OOM;
+  }
+  // Drops this handle's reference; destroys the buffer if the other handles
+  // were released in the meantime.
+  vec_fini(*v);
+  *v = copy;
+  return VEC_ERR_NONE;
 }
 
-void
-vec_fini(
-    vec_t v)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define __vec_popcount64(x) ((size_t)__builtin_popcountll(x))
+#define __vec_ctz64(x) ((size_t)__builtin_ctzll(x))
+#else
+static size_t
+__vec_popcount64(
+    uint64_t x)
 {
-  __GET_METADATA__(v)
+  x = x - ((x >> 1) & 0x5555555555555555ull);
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return (size_t)((x * 0x0101010101010101ull) >> 56);
+}
 
-  if (metadata->destr_fn) {
-    for (void *elem = vec_iter_begin(v); elem != vec_iter_end(v);
-         vec_iter_next(v, &elem)) {
-      metadata->destr_fn(elem);
-    }
+// `x` must not be 0.
+static size_t
+__vec_ctz64(
+    uint64_t x)
+{
+  size_t n = 0;
+  while(!(x & 1)) {
+    x >>= 1;
+    n++;
   }
-  if(metadata->allocationType == VEC_ALLOCATION_TYPE_HEAP) {
-    free(metadata);
+  return n;
+}
+#endif
+
+// Number of words that hold `bits` bits.
+#define __vec_words_for(bits) (((bits) + 63) / 64)
+
+/*
+ * Sets the number of words of `words` to `count` and clears every bit from
+ * bit `tail` on, so that the bits past the end of the vector are always 0.
+ */
+static vec_error_t
+__vec_words_resize(
+    vec_t *words,
+    size_t count,
+    size_t tail)
+{
+  size_t old = vec_len(*words);
+  if(vec_setlen(words, count)) {
+    return VEC_ERR_OOM;
   }
+  uint64_t *w = (uint64_t *)*words;
+  // Words past the old length are uninitialized, words past `tail` may hold
+  // stale bits.
+  size_t used  = __vec_words_for(tail);
+  size_t clean = old < used ? old : used;
+  if(count > clean) {
+    memset(w + clean, 0, (count - clean) * sizeof(uint64_t));
+  }
+  if(tail % 64 && tail / 64 < count) {
+    w[tail / 64] &= ((uint64_t)1 << (tail % 64)) - 1;
+  }
+  return VEC_ERR_NONE;
 }
 
-int
-vec_push(
-    vec_t *v, 
-    void *val)
+vec_error_t
+vec_bits_init(
+    vec_bits_t *b)
 {
-  __GET_METADATA__(*v)
+  b->length = 0;
+  b->words  = vec_init_impl(sizeof(uint64_t), NULL, NULL);
+  return b->words ? VEC_ERR_NONE : VEC_ERR_OOM;
+}
 
-  if (metadata->length == metadata->capacity) {
-    vec_error_t grow_err = vec_grow(v);
-    if(grow_err) {
-      return grow_err;
-    } else {
-      __SYNC_METADATA__(*v)
-    }
+void
+vec_bits_fini(
+    vec_bits_t *b)
+{
+  if(b->words) {
+    vec_fini(b->words);
   }
+  b->words  = NULL;
+  b->length = 0;
+}
 
-  void *dst = ((char *)*v) + (metadata->length * metadata->elemsize);
-  if (metadata->copy_fn) {
-    metadata->copy_fn(dst, val);
-  } else {
-    memcpy(dst, val, metadata->elemsize);
+int
+vec_bits_push(
+    vec_bits_t *b,
+    int bit)
+{
+  if(b->length % 64 == 0) {
+    uint64_t zero = 0;
+    int err = vec_push(&b->words, &zero);
+    if(err < 0) {
+      return err;
+    }
+  }
+  if(vec_bits_set(b, b->length, bit)) {
+    return VEC_ERR_OOM;
   }
+  return (int)b->length++;
+}
 
-  return (int)metadata->length++;
+vec_error_t
+vec_bits_setlen(
+    vec_bits_t *b,
+    size_t len)
+{
+  if(__vec_words_resize(&b->words, __vec_words_for(len), len)) {
+    return VEC_ERR_OOM;
+  }
+  b->length = len;
+  return VEC_ERR_NONE;
 }
 
-VEC_API int
-vec_append(
-  vec_t *v,
-  void **arr,
-  size_t size)
+size_t
+vec_bits_len(
+    const vec_bits_t *b)
 {
-  __GET_METADATA__(*v)
-  size_t old_len = metadata->length;
-  size_t req_len = old_len + size;
+  return b->length;
+}
 
-  vec_error_t setlen_err = vec_setlen(v, req_len);
-  if(setlen_err) {
-    return setlen_err;
+static size_t
+__vec_popcount_words_scalar(
+    const uint64_t *w,
+    size_t n)
+{
+  size_t count = 0;
+  for(size_t i = 0; i < n; i++) {
+    count += __vec_popcount64(w[i]);
   }
-  __SYNC_METADATA__(*v)
-
-  void *dst = ((char *)*v) + (old_len * metadata->elemsize);
-  memcpy(dst, *arr, metadata->elemsize * size);
+  return count;
+}
 
-  return (int)old_len;
+#if defined(__VEC_SIMD) && (defined(__x86_64__) || defined(__i386__))
+// Every CPU with AVX2 has POPCNT; without it the builtin is a bit-twiddling
+// sequence.
+__attribute__((target("popcnt"))) static size_t
+__vec_popcount_words_popcnt(
+    const uint64_t *w,
+    size_t n)
+{
+  size_t count = 0;
+  for(size_t i = 0; i < n; i++) {
+    count += __vec_popcount64(w[i]);
+  }
+  return count;
 }
+#endif
 
-vec_error_t
-vec_pop(
-    vec_t *v, 
-    void *out)
+size_t
+vec_bits_popcount(
+    const vec_bits_t *b)
 {
-  __GET_METADATA__(*v)
+  size_t n = __vec_words_for(b->length);
+#if defined(__VEC_SIMD) && (defined(__x86_64__) || defined(__i386__))
+  if(__vec_simd_detect() >= __VEC_SIMD_AVX2) {
+    return __vec_popcount_words_popcnt((const uint64_t *)b->words, n);
+  }
+#endif
+  return __vec_popcount_words_scalar((const uint64_t *)b->words, n);
+}
 
-  if(out != NULL) {
-    void *src = ((char *)*v) + ((metadata->length-1) * metadata->elemsize);
-    if (metadata->copy_fn) {
-      metadata->copy_fn(out, src);
-    } else {
-      memcpy(out, src, metadata->elemsize);
+ptrdiff_t
+vec_bits_find_first(
+    const vec_bits_t *b,
+    size_t from)
+{
+  if(from >= b->length) {
+    return -1;
+  }
+  const uint64_t *w = (const uint64_t *)b->words;
+  size_t n = __vec_words_for(b->length);
+  size_t i = from / 64;
+  uint64_t word = w[i] & (~(uint64_t)0 << (from % 64));
+  for(;;) {
+    if(word) {
+      // Bits past the length are 0, so a hit is always in range.
+      return (ptrdiff_t)(i * 64 + __vec_ctz64(word));
     }
-  } else {
-    void *elem = ((char *)*v) + ((metadata->length-1) * metadata->elemsize);
-    if (metadata->destr_fn) {
-      metadata->destr_fn(elem);
+    if(++i == n) {
+      return -1;
     }
+    word = w[i];
   }
+}
 
-  metadata->length--;
+static uint64_t
+__vec_packed_mask(
+    unsigned bits)
+{
+  return ((uint64_t)1 << bits) - 1;
+}
 
+vec_error_t
+vec_packed_init(
+    vec_packed_t *p,
+    unsigned bits)
+{
+  if(bits == 0 || bits > 32) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  p->length = 0;
+  p->bits   = bits;
+  p->words  = vec_init_impl(sizeof(uint64_t), NULL, NULL);
+  if(!p->words || __vec_words_resize(&p->words, 1, 0)) {
+    if(p->words) {
+      vec_fini(p->words);
+    }
+    p->words = NULL;
+    return VEC_ERR_OOM;
+  }
   return VEC_ERR_NONE;
 }
 
-void *
-vec_last(
-    vec_t v)
+void
+vec_packed_fini(
+    vec_packed_t *p)
 {
-  __GET_METADATA__(v)
-
-  if(metadata->length == 0) {
-    return NULL;
+  if(p->words) {
+    vec_fini(p->words);
   }
+  p->words  = NULL;
+  p->length = 0;
+}
 
-  return ((char *)v) + ((metadata->length-1) * metadata->elemsize);
+vec_error_t
+vec_packed_setlen(
+    vec_packed_t *p,
+    size_t len)
+{
+  if(len > (SIZE_MAX - 64) / p->bits) {
+    return VEC_ERR_OOM;
+  }
+  size_t used = len * p->bits;
+  if(__vec_words_resize(&p->words, __vec_words_for(used) + 1, used)) {
+    return VEC_ERR_OOM;
+  }
+  p->length = len;
+  return VEC_ERR_NONE;
 }
 
 size_t
-vec_len(
-    vec_t v)
+vec_packed_len(
+    const vec_packed_t *p)
 {
-  __GET_METADATA__(v)
-  return metadata->length;
+  return p->length;
 }
 
-size_t
-vec_capacity(
-    vec_t v)
+uint32_t
+vec_packed_get(
+    const vec_packed_t *p,
+    size_t idx)
 {
-  __GET_METADATA__(v)
-  return metadata->capacity;
+  size_t pos = idx * p->bits;
+  const uint64_t *w = (const uint64_t *)p->words + (pos / 64);
+  unsigned off = (unsigned)(pos % 64);
+  // The second shift is split in two so that it stays defined for `off == 0`;
+  // the spare word at the end makes `w[1]` always readable.
+  uint64_t v = (w[0] >> off) | ((w[1] << 1) << (63 - off));
+  return (uint32_t)(v & __vec_packed_mask(p->bits));
 }
 
-int
-vec_clear(
-    vec_t v)
+vec_error_t
+vec_packed_set(
+    vec_packed_t *p,
+    size_t idx,
+    uint32_t val)
 {
-  __GET_METADATA__(v)
+  if(__vec_is_shared(__vec_hdr(p->words)) && vec_unshare(&p->words)) {
+    return VEC_ERR_OOM;
+  }
+  size_t pos = idx * p->bits;
+  uint64_t *w = (uint64_t *)p->words + (pos / 64);
+  unsigned off = (unsigned)(pos % 64);
+  uint64_t mask = __vec_packed_mask(p->bits);
+  uint64_t v = val & mask;
+  w[0] = (w[0] & ~(mask << off)) | (v << off);
+  if(off + p->bits > 64) {
+    w[1] = (w[1] & ~(mask >> (64 - off))) | (v >> (64 - off));
+  }
+  return VEC_ERR_NONE;
+}
 
-  if (metadata->destr_fn) {
-    for (void *elem = vec_iter_begin(v); elem != vec_iter_end(v);
-         vec_iter_next(v, &elem)) {
-      metadata->destr_fn(elem);
-    }
+vec_error_t
+vec_packed_get_n(
+    const vec_packed_t *p,
+    size_t first,
+    uint32_t *out,
+    size_t n)
+{
+  if(first > p->length || n > p->length - first) {
+    return VEC_ERR_OUT_OF_BOUNDS;
   }
 
-  metadata->length = 0;
-  return 0;
+  unsigned bits = p->bits;
+  uint64_t mask = __vec_packed_mask(bits);
+  size_t pos = first * bits;
+  const uint64_t *w = (const uint64_t *)p->words + (pos / 64);
+  unsigned off = (unsigned)(pos % 64);
+  uint64_t cur = *w;
+  for(size_t i = 0; i < n; i++) {
+    uint64_t v = cur >> off;
+    off += bits;
+    if(off >= 64) {
+      // The spare word at the end keeps this load in bounds.
+      cur = *++w;
+      off -= 64;
+      if(off) {
+        v |= cur << (bits - off);
+      }
+    }
+    out[i] = (uint32_t)(v & mask);
+  }
+  return VEC_ERR_NONE;
 }
 
 vec_error_t
-vec_setlen(
-    vec_t *v, 
-    size_t len)
+vec_packed_set_n(
+    vec_packed_t *p,
+    size_t first,
+    const uint32_t *vals,
+    size_t n)
 {
-  __GET_METADATA__(*v)
+  if(first > p->length || n > p->length - first) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  if(!n) {
+    return VEC_ERR_NONE;
+  }
+  if(__vec_is_shared(__vec_hdr(p->words)) && vec_unshare(&p->words)) {
+    return VEC_ERR_OOM;
+  }
 
-  while(len > metadata->capacity) {
-    vec_error_t grow_err = vec_grow(v);
-    if(grow_err) {
-      return grow_err;
+  unsigned bits = p->bits;
+  uint64_t mask = __vec_packed_mask(bits);
+  size_t pos = first * bits;
+  uint64_t *w = (uint64_t *)p->words + (pos / 64);
+  unsigned off = (unsigned)(pos % 64);
+  // Whole words are assembled in `acc` and stored once; only the bits before
+  // the first element and after the last one are read back from memory.
+  uint64_t acc = *w & (((uint64_t)1 << off) - 1);
+  for(size_t i = 0; i < n; i++) {
+    uint64_t v = vals[i] & mask;
+    acc |= v << off;
+    off += bits;
+    if(off >= 64) {
+      *w++ = acc;
+      off -= 64;
+      acc = off ? v >> (bits - off) : 0;
     }
-    __SYNC_METADATA__(*v)
   }
-
-  metadata->length = len;
+  if(off) {
+    *w = (*w & ~(((uint64_t)1 << off) - 1)) | acc;
+  }
   return VEC_ERR_NONE;
 }
 
-vec_error_t
-vec_setcapacity(
-    vec_t *v, 
-    size_t cap)
+int
+vec_packed_push(
+    vec_packed_t *p,
+    uint32_t val)
 {
-  __GET_METADATA__(*v)
+  return vec_packed_append(p, &val, 1);
+}
 
-  if(metadata->allocationType == VEC_ALLOCATION_TYPE_STACK) {
+int
+vec_packed_append(
+    vec_packed_t *p,
+    const uint32_t *vals,
+    size_t n)
+{
+  size_t old_len = p->length;
+  if(vec_packed_setlen(p, old_len + n)) {
     return VEC_ERR_OOM;
   }
+  vec_packed_set_n(p, old_len, vals, n);
+  return (int)old_len;
+}
 
-  if(metadata->capacity == cap) {
-    return VEC_ERR_NONE;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define __vec_prefetch_read(addr)  __builtin_prefetch((addr), 0, 3)
+#define __vec_prefetch_write(addr) __builtin_prefetch((addr), 1, 3)
+#else
+#define __vec_prefetch_read(addr)  ((void)(addr))
+#define __vec_prefetch_write(addr) ((void)(addr))
+#endif
+
+size_t
+vec_zip_len(
+    size_t n,
+    const vec_t *vs)
+{
+  if(!n) {
+    return 0;
+  }
+  size_t len = __vec_hdr(vs[0])->length;
+  for(size_t i = 1; i < n; i++) {
+    size_t l = __vec_hdr(vs[i])->length;
+    len = l < len ? l : len;
   }
+  return len;
+}
 
-  void *buf = ((char *)(*v) - sizeof(struct vec_meta_t));
-  void *tmp = realloc(buf, sizeof(struct vec_meta_t) + (cap * metadata->elemsize));
+static int
+__vec_indices_in_range(
+    const size_t *idx,
+    size_t n,
+    size_t len)
+{
+  size_t bad = 0;
+  for(size_t i = 0; i < n; i++) {
+    bad |= idx[i] >= len;
+  }
+  return !bad;
+}
 
-  if (!tmp) {
-    return VEC_ERR_OOM;
+/*
+ * `size` is a constant at every call site of the kernels below, so that the
+ * copies turn into plain loads and stores once they are inlined.
+ */
+static inline void
+__vec_gather_kernel(
+    char *dst,
+    const char *src,
+    const size_t *idx,
+    size_t n,
+    size_t size)
+{
+  size_t i = 0;
+#if VEC_PREFETCH_DISTANCE > 0
+  for(; i + VEC_PREFETCH_DISTANCE < n; i++) {
+    __vec_prefetch_read(src + idx[i + VEC_PREFETCH_DISTANCE] * size);
+    memcpy(dst + i * size, src + idx[i] * size, size);
+  }
+#endif
+  for(; i < n; i++) {
+    memcpy(dst + i * size, src + idx[i] * size, size);
   }
+}
 
-  if(buf != tmp) {
-    buf = tmp;
-    metadata           = (struct vec_meta_t *)buf;
-    *v = (char *)buf + sizeof(struct vec_meta_t);
+static inline void
+__vec_scatter_kernel(
+    char *dst,
+    const char *src,
+    const size_t *idx,
+    size_t n,
+    size_t size)
+{
+  size_t i = 0;
+#if VEC_PREFETCH_DISTANCE > 0
+  for(; i + VEC_PREFETCH_DISTANCE < n; i++) {
+    __vec_prefetch_write(dst + idx[i + VEC_PREFETCH_DISTANCE] * size);
+    memcpy(dst + idx[i] * size, src + i * size, size);
   }
+#endif
+  for(; i < n; i++) {
+    memcpy(dst + idx[i] * size, src + i * size, size);
+  }
+}
 
-  metadata->capacity = cap;
-  return VEC_ERR_NONE;
+#define __VEC_DISPATCH_SIZE(kernel, dst, src, idx, n, size) \
+  switch(size) {                                            \
+    case 1:  kernel(dst, src, idx, n, 1);  break;           \
+    case 2:  kernel(dst, src, idx, n, 2);  break;           \
+    case 4:  kernel(dst, src, idx, n, 4);  break;           \
+    case 8:  kernel(dst, src, idx, n, 8);  break;           \
+    case 16: kernel(dst, src, idx, n, 16); break;           \
+    default: kernel(dst, src, idx, n, size);                \
+  }
+
+int
+vec_gather(
+    vec_t *dst,
+    vec_t src,
+    vec_t indices)
+{
+  const size_t *idx = (const size_t *)indices;
+  size_t n = __vec_hdr(indices)->length;
+  if(!__vec_indices_in_range(idx, n, __vec_hdr(src)->length)) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+
+  __GET_METADATA__(*dst)
+  size_t old_len = metadata->length;
+  vec_error_t setlen_err = vec_setlen(dst, old_len + n);
+  if(setlen_err) {
+    return setlen_err;
+  }
+  __SYNC_METADATA__(*dst)
+
+  size_t size = metadata->elemsize;
+  char *out = (char *)*dst + old_len * size;
+  __VEC_DISPATCH_SIZE(__vec_gather_kernel, out, (const char *)src, idx, n, size)
+
+#ifdef VEC_STATS
+  metadata->stats.pushes += n;
+  __vec_atomic_fetch_add(&__vec_global_stats.pushes, n, __VEC_RELAXED);
+#endif
+
+  return (int)old_len;
 }
 
 vec_error_t
-vec_grow(
-    vec_t *v)
+vec_scatter(
+    vec_t *dst,
+    vec_t src,
+    vec_t indices)
 {
-  __GET_METADATA__(*v)
-  return vec_setcapacity(v, metadata->capacity * VEC_GROWTH_RATE);
+  const size_t *idx = (const size_t *)indices;
+  size_t n = __vec_hdr(indices)->length;
+  if(__vec_hdr(src)->length != n ||
+     !__vec_indices_in_range(idx, n, __vec_hdr(*dst)->length)) {
+    return VEC_ERR_OUT_OF_BOUNDS;
+  }
+  if(vec_unshare(dst)) {
+    return VEC_ERR_OOM;
+  }
+
+  size_t size = __vec_hdr(*dst)->elemsize;
+  __VEC_DISPATCH_SIZE(__vec_scatter_kernel, (char *)*dst, (const char *)src, idx, n, size)
+  return VEC_ERR_NONE;
 }
 
 #endif